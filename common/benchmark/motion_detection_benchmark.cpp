@@ -0,0 +1,510 @@
+/* motion_detection_benchmark.cpp
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+/*
+ * Times the individual stages of the pipeline and prints one CSV line per
+ * case: case,width,height,parameter,value,iterations,mean_ms,min_ms
+ *
+ * Frames are a textured background that translates and rotates, with a
+ * square moving against it, unless --samples points to a directory of
+ * images, which are then used in sorted order.
+ */
+
+#include <motion_detection/optical_flow_calculator.h>
+#include <motion_detection/trajectory_tracker.h>
+#include <motion_detection/frame_cache.h>
+#include <motion_detection/outlier_detector.h>
+#include <motion_detection/flow_clusterer.h>
+#include <motion_detection/VarFlow.h>
+#include <motion_detection/slic.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+
+namespace bfs = boost::filesystem;
+
+namespace
+{
+
+const int NUM_FRAMES = 5;
+
+struct Timing
+{
+    double mean_ms;
+    double min_ms;
+};
+
+struct Options
+{
+    int iterations;
+    std::string samples;
+    std::string filter;
+};
+
+std::vector<cv::Mat> sample_images;
+
+/**
+ * Runs function once to warm up, then iterations times.
+ */
+template <typename F>
+Timing measure(F function, int iterations)
+{
+    function();
+    Timing timing;
+    timing.mean_ms = 0.0;
+    timing.min_ms = std::numeric_limits<double>::max();
+    for (int i = 0; i < iterations; i++)
+    {
+        int64 start = cv::getTickCount();
+        function();
+        double ms = (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+        timing.mean_ms += ms;
+        timing.min_ms = std::min(timing.min_ms, ms);
+    }
+    timing.mean_ms /= iterations;
+    return timing;
+}
+
+void report(const std::string &name, const cv::Size &size, const std::string &parameter, double value, int iterations, const Timing &timing)
+{
+    std::cout << name << "," << size.width << "," << size.height << "," << parameter << "," << value << ","
+              << iterations << "," << timing.mean_ms << "," << timing.min_ms << std::endl;
+}
+
+bool selected(const Options &options, const std::string &name)
+{
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+/**
+ * BGR frames of the given size; frame i of the synthetic sequence is the
+ * background shifted by i pixels and rotated by i * 0.5 degrees, with a
+ * square moving down and to the left.
+ */
+std::vector<cv::Mat> makeFrames(const cv::Size &size, int num_frames)
+{
+    std::vector<cv::Mat> frames;
+    if (!sample_images.empty())
+    {
+        for (int i = 0; i < num_frames; i++)
+        {
+            cv::Mat frame;
+            cv::resize(sample_images.at(i % sample_images.size()), frame, size, 0, 0, cv::INTER_AREA);
+            frames.push_back(frame);
+        }
+        return frames;
+    }
+
+    cv::RNG rng(12345);
+    cv::Mat texture(size.height * 2, size.width * 2, CV_8UC3);
+    rng.fill(texture, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::GaussianBlur(texture, texture, cv::Size(7, 7), 2.0);
+
+    cv::Mat square(size.height / 6, size.height / 6, CV_8UC3);
+    rng.fill(square, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::GaussianBlur(square, square, cv::Size(5, 5), 1.0);
+
+    cv::Point2f centre(texture.cols / 2.0, texture.rows / 2.0);
+    for (int i = 0; i < num_frames; i++)
+    {
+        cv::Mat transform = cv::getRotationMatrix2D(centre, i * 0.5, 1.0);
+        transform.at<double>(0, 2) += i - size.width / 2;
+        transform.at<double>(1, 2) += i * 0.5 - size.height / 2;
+        cv::Mat frame;
+        cv::warpAffine(texture, frame, transform, size);
+
+        cv::Rect box(size.width / 2 - i * 3, size.height / 3 + i * 3, square.cols, square.rows);
+        cv::Mat roi(frame, box);
+        square.copyTo(roi);
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+/**
+ * Point trajectories of a background that translates and rotates, with
+ * ten percent of the points on an object moving against it.
+ */
+std::vector<std::vector<cv::Point2f> > makeTrajectories(int num_trajectories, int trajectory_size)
+{
+    cv::RNG rng(12345);
+    std::vector<std::vector<cv::Point2f> > trajectories(num_trajectories);
+    for (int i = 0; i < num_trajectories; i++)
+    {
+        cv::Point2f point(rng.uniform(10.0f, 310.0f), rng.uniform(10.0f, 230.0f));
+        bool foreground = i % 10 == 0;
+        for (int j = 0; j < trajectory_size; j++)
+        {
+            trajectories.at(i).push_back(point + cv::Point2f(rng.gaussian(0.2), rng.gaussian(0.2)));
+            double angle = 0.005;
+            cv::Point2f rotated(std::cos(angle) * point.x - std::sin(angle) * point.y,
+                                std::sin(angle) * point.x + std::cos(angle) * point.y);
+            point = rotated + cv::Point2f(1.5f, 0.5f);
+            if (foreground)
+            {
+                point += cv::Point2f(-4.0f, 3.0f);
+            }
+        }
+    }
+    return trajectories;
+}
+
+/**
+ * Flow field as written by OpticalFlowCalculator: the background moves
+ * right, a square in the middle moves up.
+ */
+FlowField makeFlowField(const cv::Size &size, int pixel_step)
+{
+    FlowField flow_vectors;
+    flow_vectors.reset(size, pixel_step);
+    cv::Rect object(size.width / 3, size.height / 3, size.width / 4, size.height / 4);
+    for (int i = 0; i < flow_vectors.size(); i++)
+    {
+        cv::Point pixel = flow_vectors.getPixel(i);
+        if (object.contains(pixel))
+        {
+            flow_vectors.setVector(i, pixel, cv::Point2f(0.5f, 4.0f));
+        }
+        else
+        {
+            flow_vectors.setVector(i, pixel, cv::Point2f(2.0f, 0.1f));
+        }
+    }
+    return flow_vectors;
+}
+
+std::vector<cv::Point2f> makeBlobs(int num_points)
+{
+    cv::RNG rng(12345);
+    std::vector<cv::Point2f> points;
+    cv::Point2f centres[] = { cv::Point2f(60, 60), cv::Point2f(250, 80), cv::Point2f(160, 200) };
+    for (int i = 0; i < num_points; i++)
+    {
+        cv::Point2f centre = centres[i % 3];
+        points.push_back(centre + cv::Point2f(rng.gaussian(15.0), rng.gaussian(15.0)));
+    }
+    return points;
+}
+
+void benchmarkOpticalFlow(const Options &options, const std::vector<cv::Size> &sizes)
+{
+    int pixel_steps[] = { 5, 10, 20 };
+    for (int s = 0; s < sizes.size(); s++)
+    {
+        std::vector<cv::Mat> frames = makeFrames(sizes.at(s), NUM_FRAMES);
+        for (int p = 0; p < 3; p++)
+        {
+            int pixel_step = pixel_steps[p];
+            OpticalFlowCalculator ofc;
+            FlowField optical_flow_vectors;
+
+            if (selected(options, "calculateOpticalFlow"))
+            {
+                Timing timing = measure([&]()
+                {
+                    ofc.calculateOpticalFlow(frames.at(0), frames.at(1), optical_flow_vectors, pixel_step, 1.0);
+                }, options.iterations);
+                report("calculateOpticalFlow", sizes.at(s), "pixel_step", pixel_step, options.iterations, timing);
+            }
+
+            if (selected(options, "calculateOpticalFlowTrajectory"))
+            {
+                std::vector<std::vector<cv::Point2f> > trajectories;
+                cv::Mat comp;
+                Timing timing = measure([&]()
+                {
+                    trajectories.clear();
+                    ofc.calculateOpticalFlowTrajectory(frames, optical_flow_vectors, trajectories, pixel_step, comp, 1.0);
+                }, options.iterations);
+                report("calculateOpticalFlowTrajectory", sizes.at(s), "pixel_step", pixel_step, options.iterations, timing);
+            }
+
+            if (selected(options, "TrajectoryTracker"))
+            {
+                // one incremental step with a full window, including the pyramid
+                TrajectoryTracker tracker;
+                FrameCache frame_cache;
+                frame_cache.setCapacity(NUM_FRAMES);
+                tracker.setParameters(NUM_FRAMES, pixel_step, 1.0);
+                int frame_index = 0;
+                Timing timing = measure([&]()
+                {
+                    const CachedFrame &frame = frame_cache.addFrame(frames.at(frame_index++ % frames.size()));
+                    tracker.addFrame(frame.pyramid, optical_flow_vectors);
+                }, options.iterations);
+                report("TrajectoryTracker::addFrame", sizes.at(s), "pixel_step", pixel_step, options.iterations, timing);
+            }
+        }
+    }
+}
+
+void benchmarkFitSubspace(const Options &options)
+{
+    if (!selected(options, "fitSubspace"))
+    {
+        return;
+    }
+    int counts[] = { 100, 500, 2000, 5000 };
+    // one thread, and one per core
+    int thread_counts[] = { 1, 0 };
+    for (int num_motions = 1; num_motions <= 3; num_motions++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            std::vector<std::vector<cv::Point2f> > trajectories = makeTrajectories(counts[c], num_motions * 2 + 1);
+            for (int t = 0; t < 2; t++)
+            {
+                OutlierDetector od;
+                od.setRansacParameters(0, thread_counts[t]);
+                std::vector<cv::Point2f> outlier_points;
+                Timing timing = measure([&]()
+                {
+                    outlier_points.clear();
+                    od.fitSubspace(trajectories, outlier_points, num_motions, 0.5);
+                }, options.iterations);
+                std::stringstream name;
+                name << "fitSubspace(num_motions=" << num_motions << ",threads=" << thread_counts[t] << ")";
+                report(name.str(), cv::Size(320, 240), "trajectories", counts[c], options.iterations, timing);
+            }
+        }
+    }
+
+    // fixed trajectory budget
+    int max_trajectories = 500;
+    for (int c = 0; c < 4; c++)
+    {
+        std::vector<std::vector<cv::Point2f> > trajectories = makeTrajectories(counts[c], 5);
+        OutlierDetector od;
+        od.setRansacParameters(0, 1);
+        od.setMaxTrajectories(max_trajectories);
+        std::vector<cv::Point2f> outlier_points;
+        Timing timing = measure([&]()
+        {
+            outlier_points.clear();
+            od.fitSubspace(trajectories, outlier_points, 2, 0.5);
+        }, options.iterations);
+        std::stringstream name;
+        name << "fitSubspace(num_motions=2,max_trajectories=" << max_trajectories << ")";
+        report(name.str(), cv::Size(320, 240), "trajectories", counts[c], options.iterations, timing);
+    }
+}
+
+void benchmarkClustering(const Options &options, const std::vector<cv::Size> &sizes)
+{
+    if (selected(options, "getClusters"))
+    {
+        int pixel_steps[] = { 5, 10, 20 };
+        for (int s = 0; s < sizes.size(); s++)
+        {
+            for (int p = 0; p < 3; p++)
+            {
+                FlowField flow_vectors = makeFlowField(sizes.at(s), pixel_steps[p]);
+                FlowClusterer fc;
+                Timing timing = measure([&]()
+                {
+                    fc.getClusters(flow_vectors, 50.0, 0.15, 6);
+                }, options.iterations);
+                report("getClusters", sizes.at(s), "pixel_step", pixel_steps[p], options.iterations, timing);
+            }
+        }
+    }
+
+    if (selected(options, "clusterFlowVectors"))
+    {
+        int pixel_steps[] = { 5, 10, 20 };
+        for (int s = 0; s < sizes.size(); s++)
+        {
+            for (int p = 0; p < 3; p++)
+            {
+                FlowField flow_vectors = makeFlowField(sizes.at(s), pixel_steps[p]);
+                // warm-started from the previous iteration, as from the previous frame
+                FlowClusterer fc;
+                std::vector<int> labels;
+                Timing timing = measure([&]()
+                {
+                    fc.clusterFlowVectors(flow_vectors, labels);
+                }, options.iterations);
+                report("clusterFlowVectors", sizes.at(s), "pixel_step", pixel_steps[p], options.iterations, timing);
+            }
+        }
+    }
+
+    if (selected(options, "findOutliers"))
+    {
+        int pixel_steps[] = { 5, 10, 20 };
+        for (int s = 0; s < sizes.size(); s++)
+        {
+            for (int p = 0; p < 3; p++)
+            {
+                FlowField flow_vectors = makeFlowField(sizes.at(s), pixel_steps[p]);
+                OutlierDetector od;
+                cv::Mat outlier_mask;
+                Timing timing = measure([&]()
+                {
+                    od.findOutliers(flow_vectors, outlier_mask, false, false);
+                }, options.iterations);
+                report("findOutliers", sizes.at(s), "pixel_step", pixel_steps[p], options.iterations, timing);
+            }
+        }
+    }
+
+    if (selected(options, "clusterEuclidean"))
+    {
+        int counts[] = { 100, 500, 2000, 5000 };
+        for (int c = 0; c < 4; c++)
+        {
+            std::vector<cv::Point2f> points = makeBlobs(counts[c]);
+            FlowClusterer fc;
+            Timing timing = measure([&]()
+            {
+                fc.clusterEuclidean(points, 50.0, 6);
+            }, options.iterations);
+            report("clusterEuclidean", cv::Size(320, 240), "points", counts[c], options.iterations, timing);
+        }
+    }
+
+    if (selected(options, "clusterDensity"))
+    {
+        int counts[] = { 500, 5000, 20000, 50000 };
+        for (int c = 0; c < 4; c++)
+        {
+            std::vector<cv::Point2f> points = makeBlobs(counts[c]);
+            FlowClusterer fc;
+            Timing timing = measure([&]()
+            {
+                fc.clusterDensity(points, 50.0, 4, 6);
+            }, options.iterations);
+            report("clusterDensity", cv::Size(320, 240), "points", counts[c], options.iterations, timing);
+        }
+
+        int pixel_steps[] = { 5, 10, 20 };
+        for (int s = 0; s < sizes.size(); s++)
+        {
+            for (int p = 0; p < 3; p++)
+            {
+                FlowField flow_vectors = makeFlowField(sizes.at(s), pixel_steps[p]);
+                FlowClusterer fc;
+                Timing timing = measure([&]()
+                {
+                    fc.clusterDensity(flow_vectors, 50.0, 0.15, 4, 6);
+                }, options.iterations);
+                report("clusterDensity(flow)", sizes.at(s), "pixel_step", pixel_steps[p], options.iterations, timing);
+            }
+        }
+    }
+}
+
+void benchmarkDenseFlow(const Options &options, const std::vector<cv::Size> &sizes)
+{
+    for (int s = 0; s < sizes.size(); s++)
+    {
+        std::vector<cv::Mat> frames = makeFrames(sizes.at(s), 2);
+        cv::Mat gray1, gray2;
+        cv::cvtColor(frames.at(0), gray1, CV_BGR2GRAY);
+        cv::cvtColor(frames.at(1), gray2, CV_BGR2GRAY);
+        int width = sizes.at(s).width;
+        int height = sizes.at(s).height;
+
+        if (selected(options, "VarFlow"))
+        {
+            // same settings as OpticalFlowCalculator::varFlow
+            cv::Mat u(sizes.at(s), CV_32FC1);
+            cv::Mat v(sizes.at(s), CV_32FC1);
+            Timing timing = measure([&]()
+            {
+                VarFlow var_flow(width, height, 4, 0, 2, 2, 2.8, 1400, 1.5);
+                IplImage image_a = gray1;
+                IplImage image_b = gray2;
+                IplImage image_u = u;
+                IplImage image_v = v;
+                var_flow.CalcFlow(&image_a, &image_b, &image_u, &image_v, false);
+            }, options.iterations);
+            report("VarFlow::CalcFlow", sizes.at(s), "max_level", 4, options.iterations, timing);
+        }
+
+        if (selected(options, "Slic"))
+        {
+            // same settings as OpticalFlowCalculator::superPixelFlow
+            cv::Mat lab;
+            cv::cvtColor(frames.at(0), lab, CV_BGR2Lab);
+            int step = std::sqrt((width * height) / 50.0);
+            Timing timing = measure([&]()
+            {
+                Slic slic;
+                IplImage image = lab;
+                slic.generate_superpixels(&image, step, 40);
+            }, options.iterations);
+            report("Slic::generate_superpixels", sizes.at(s), "step", step, options.iterations, timing);
+        }
+    }
+}
+
+bool loadSamples(const std::string &directory)
+{
+    if (!bfs::is_directory(directory))
+    {
+        return false;
+    }
+    std::vector<std::string> files;
+    for (bfs::directory_iterator it(directory); it != bfs::directory_iterator(); ++it)
+    {
+        files.push_back(it->path().string());
+    }
+    std::sort(files.begin(), files.end());
+    for (int i = 0; i < files.size() && sample_images.size() < NUM_FRAMES; i++)
+    {
+        cv::Mat image = cv::imread(files.at(i));
+        if (!image.empty())
+        {
+            sample_images.push_back(image);
+        }
+    }
+    return sample_images.size() == NUM_FRAMES;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    options.iterations = 10;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string option(argv[i]);
+        if (option == "--iterations") options.iterations = std::max(1, std::atoi(argv[i + 1]));
+        else if (option == "--samples") options.samples = argv[i + 1];
+        else if (option == "--filter") options.filter = argv[i + 1];
+        else
+        {
+            std::cerr << "usage: " << argv[0] << " [--iterations N] [--samples <image directory>] [--filter <case name>]" << std::endl;
+            return 1;
+        }
+    }
+    if (!options.samples.empty() && !loadSamples(options.samples))
+    {
+        std::cerr << "need at least " << NUM_FRAMES << " images in " << options.samples << std::endl;
+        return 1;
+    }
+
+    std::vector<cv::Size> sizes;
+    sizes.push_back(cv::Size(320, 240));
+    sizes.push_back(cv::Size(640, 480));
+
+    std::cout << "case,width,height,parameter,value,iterations,mean_ms,min_ms" << std::endl;
+    benchmarkOpticalFlow(options, sizes);
+    benchmarkFitSubspace(options);
+    benchmarkClustering(options, sizes);
+    benchmarkDenseFlow(options, sizes);
+    return 0;
+}
@@ -0,0 +1,78 @@
+/* bounded_queue.h
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+#ifndef BOUNDED_QUEUE_H_
+#define BOUNDED_QUEUE_H_
+
+#include <deque>
+#include <mutex>
+
+/**
+ * FIFO queue in front of a pipeline stage holding at most capacity items.
+ * None of the operations block; a full queue either refuses the new item
+ * or drops its oldest ones.
+ */
+template <typename T>
+class BoundedQueue
+{
+    public:
+        explicit BoundedQueue(size_t capacity = 1) : capacity_(capacity < 1 ? 1 : capacity)
+        {
+        }
+
+        void setCapacity(size_t capacity)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            capacity_ = capacity < 1 ? 1 : capacity;
+        }
+
+        // returns false if the queue is full
+        bool tryPush(const T &item)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (items_.size() >= capacity_)
+            {
+                return false;
+            }
+            items_.push_back(item);
+            return true;
+        }
+
+        // makes room by dropping the oldest items and returns how many were
+        // dropped
+        int pushDropOldest(const T &item)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            int dropped = 0;
+            while (items_.size() >= capacity_)
+            {
+                items_.pop_front();
+                dropped++;
+            }
+            items_.push_back(item);
+            return dropped;
+        }
+
+        // returns false if the queue is empty
+        bool tryPop(T &item)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (items_.empty())
+            {
+                return false;
+            }
+            item = items_.front();
+            items_.pop_front();
+            return true;
+        }
+
+    private:
+        std::deque<T> items_;
+        size_t capacity_;
+        std::mutex mutex_;
+};
+#endif
@@ -0,0 +1,98 @@
+/* density_clusterer.h
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+#ifndef DENSITY_CLUSTERER_H_
+#define DENSITY_CLUSTERER_H_
+
+#include <opencv2/core/core.hpp>
+#include <motion_detection/union_find.h>
+#include <motion_detection/worker_team.h>
+#include <memory>
+
+/**
+ * Density-based clustering (DBSCAN). Two points are neighbours if they are
+ * closer than distance_threshold and, if directions are given, the dot
+ * product of their unit directions is above min_cosine. Points with at least
+ * min_points neighbours, themselves included, are core points; core points
+ * that are neighbours share a cluster. Other points join the cluster of
+ * their closest core neighbour or are noise.
+ *
+ * Neighbours are looked up in a uniform grid over position and direction,
+ * with cells small enough that all points of a cell are neighbours. Finding
+ * the core points, joining them and assigning the other points is split over
+ * threads. Which points share a cluster does not depend on the number of
+ * threads or the order of the points; only the cluster numbers follow the
+ * order of the points.
+ */
+class DensityClusterer
+{
+    public:
+        DensityClusterer();
+        virtual ~DensityClusterer();
+
+        // 0 for one per core
+        void setNumThreads(int num_threads);
+
+        // labels holds the cluster of every point, -1 for noise; clusters are
+        // numbered in the order of their first point. directions is either
+        // empty or holds a unit vector per point. Returns the number of clusters
+        int cluster(const std::vector<cv::Point2f> &points, const std::vector<cv::Point2f> &directions,
+                    double distance_threshold, double min_cosine, int min_points, std::vector<int> &labels);
+
+    private:
+        struct CellOffset
+        {
+            int col;
+            int row;
+            int bin;
+        };
+
+        void buildGrid(const std::vector<cv::Point2f> &points, const std::vector<cv::Point2f> &directions);
+        bool isNeighbour(int a, int b) const;
+        // orders points by position and direction, so that ties between core
+        // points are broken the same way whatever the order of the input;
+        // points that compare equal are neighbours and share a cluster
+        bool comesBefore(int a, int b) const;
+        // -1 if the neighbour cell is outside the grid
+        int getNeighbourCell(int cell, const CellOffset &offset) const;
+        void findCorePoints(int begin, int end);
+        void joinCorePoints(int begin, int end);
+        void assignBorderPoints(int begin, int end);
+
+    private:
+        int num_threads_;
+        // started on the first call that needs threads
+        std::unique_ptr<WorkerTeam> team_;
+        double distance_threshold_;
+        double min_cosine_;
+        int min_points_;
+        bool use_directions_;
+        // all points of a cell are neighbours of each other
+        bool cells_connected_;
+
+        int grid_cols_;
+        int grid_rows_;
+        // direction bins, which wrap around
+        int grid_bins_;
+        // neighbour cells relative to a cell, including itself
+        std::vector<CellOffset> offsets_;
+        // points of cell c are cell_starts_[c] .. cell_starts_[c + 1] - 1
+        std::vector<int> cell_starts_;
+
+        // the points sorted by cell
+        std::vector<int> cells_;
+        std::vector<int> positions_;
+        std::vector<cv::Point2f> points_;
+        std::vector<cv::Point2f> directions_;
+
+        std::vector<uchar> core_;
+        // closest core neighbour of the points that are not core points
+        std::vector<int> borders_;
+        AtomicUnionFind sets_;
+        std::vector<int> cluster_index_;
+};
+#endif
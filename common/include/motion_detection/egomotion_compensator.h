@@ -8,17 +8,20 @@
 #ifndef EGOMOTION_COMPENSATOR_H_
 #define EGOMOTION_COMPENSATOR_H_
 
+#include <motion_detection/flow_field.h>
+#include <vector>
+
 class EgomotionCompensator
 {
     public:
         EgomotionCompensator();
         virtual ~EgomotionCompensator();
 
-        void calculateCompensatedVectors(const cv::Mat &optical_flow_vectors, const std::vector<double> &odom, cv::Mat &compensated_vectors, int pixel_step);            
+        void calculateCompensatedVectors(const FlowField &optical_flow_vectors, const std::vector<double> &odom, FlowField &compensated_vectors);            
 
     private:
         void getFOE(const std::vector<double> &odom, double &foe_x, double &foe_y);
-        double getExpectedOrientation(double x, double y, double foe_x, double foe_y);
+        double getExpectedOrientation(double x, double y, double foe_x, double foe_y, int image_width, int image_height);
 
 };
 
@@ -12,6 +12,7 @@
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
 #include <opencv2/core/core.hpp>
+#include <motion_detection/flow_field.h>
 
 typedef pcl::PointXYZRGB PointT;
 typedef pcl::PCLPointCloud2 PointCloud;
@@ -25,7 +26,8 @@ class ExpectedFlowCalculator
         
         virtual ~ExpectedFlowCalculator();
 
-        void calculateExpectedFlow(PointCloud frame, std::vector<double> odom, cv::Mat &projected_image, cv::Mat &optical_flow_vectors, int pixel_step);
+        // optical_flow_vectors must already be reset to the grid of the image
+        void calculateExpectedFlow(PointCloud frame, std::vector<double> odom, cv::Mat &projected_image, FlowField &optical_flow_vectors);
 
         void setCameraParameters(cv::Mat camera_matrix, cv::Mat translation, cv::Mat rotation, cv::Mat distortion);
 
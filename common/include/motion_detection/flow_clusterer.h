@@ -9,6 +9,9 @@
 #define FLOW_CLUSTERER_H_
 
 #include <opencv2/core/core.hpp>
+#include <motion_detection/flow_field.h>
+#include <motion_detection/density_clusterer.h>
+#include <random>
 
 class FlowClusterer
 {
@@ -17,11 +20,52 @@ class FlowClusterer
         FlowClusterer();
         virtual ~FlowClusterer();
 
-        cv::Mat clusterFlowVectors(const cv::Mat &flow_vectors);
+        // k-means of the start points of the moving vectors, one row per
+        // centre. The centres are kept and refined with mini-batches on the
+        // next call, so a frame costs a few passes over its moving vectors.
+        // labels holds the centre of every cell, -1 for cells not moving
+        cv::Mat clusterFlowVectors(const FlowField &flow_vectors, std::vector<int> &labels);
+        cv::Mat clusterFlowVectors(const FlowField &flow_vectors);
+        // forgets the centres, e.g. when the scene changes
+        void resetCenters();
 
-        std::vector<cv::Point2f> getClustersCenters(const cv::Mat &flow_vectors, int pixel_step, double distance_threshold, double angular_threshold);
+        std::vector<cv::Point2f> getClustersCenters(const FlowField &flow_vectors, double distance_threshold, double angular_threshold);
 
-        std::vector<std::vector<cv::Vec4d> > getClusters(const cv::Mat &flow_vectors, int pixel_step, double distance_threshold, double angular_threshold);
-        std::vector<std::vector<cv::Point2f> > clusterEuclidean(const std::vector<cv::Point2f> &points, double distance_threshold);
+        // connected components of the moving vectors, where vectors closer than
+        // distance_threshold with an angle below angular_threshold are connected;
+        // components of fewer than min_cluster_size vectors are dropped
+        std::vector<std::vector<cv::Vec4d> > getClusters(const FlowField &flow_vectors, double distance_threshold, double angular_threshold, int min_cluster_size);
+        // connected components of the points, where points closer than
+        // distance_threshold are connected; the result does not depend on
+        // the order of the points
+        std::vector<std::vector<cv::Point2f> > clusterEuclidean(const std::vector<cv::Point2f> &points, double distance_threshold, int min_cluster_size);
+
+        // density-based alternatives to getClusters and clusterEuclidean, see
+        // DensityClusterer; points with fewer than min_points neighbours
+        // within distance_threshold only join the cluster of a denser neighbour
+        std::vector<std::vector<cv::Vec4d> > clusterDensity(const FlowField &flow_vectors, double distance_threshold, double angular_threshold, int min_points, int min_cluster_size);
+        std::vector<std::vector<cv::Point2f> > clusterDensity(const std::vector<cv::Point2f> &points, double distance_threshold, int min_points, int min_cluster_size);
+        // threads of the density-based clustering, 0 for one per core
+        void setNumThreads(int num_threads);
+
+    private:
+        // k-means++ seeding from the current samples, up to num_centers
+        void addCenters(int num_centers);
+        int getClosestCenter(const cv::Point2f &point, double &squared_distance) const;
+
+    private:
+        int num_clusters_;
+        int batch_size_;
+        int num_batches_;
+        std::vector<cv::Point2f> centers_;
+        // number of samples each centre has moved towards, sets its learning rate
+        std::vector<double> center_counts_;
+        std::vector<cv::Point2f> samples_;
+        std::vector<int> sample_cells_;
+        std::mt19937 rng_;
+
+        DensityClusterer density_clusterer_;
+        std::vector<cv::Point2f> directions_;
+        std::vector<int> labels_;
 };
 #endif
@@ -9,6 +9,7 @@
 #define FLOW_DIFFERENCE_CALCULATOR_H_
 
 #include <opencv2/core/core.hpp>
+#include <motion_detection/flow_field.h>
 
 class FlowDifferenceCalculator
 {
@@ -16,6 +17,7 @@ class FlowDifferenceCalculator
         FlowDifferenceCalculator();
         virtual ~FlowDifferenceCalculator();
 
-        void calculateFlowDifference(const cv::Mat &first, const cv::Mat &second, cv::Mat &diff, int pixel_step);
+        // first and second must have the same grid
+        void calculateFlowDifference(const FlowField &first, const FlowField &second, FlowField &diff);
 };
 #endif
@@ -0,0 +1,71 @@
+/* flow_field.h
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+#ifndef FLOW_FIELD_H_
+#define FLOW_FIELD_H_
+
+#include <opencv2/core/core.hpp>
+
+/**
+ * Optical flow sampled every pixel_step pixels. Cell (row, col) belongs to
+ * the grid point at pixel (col * pixel_step, row * pixel_step) and holds the
+ * start point and displacement of the vector tracked from there. The cells
+ * are stored row-major, one plane per component, so only the grid is
+ * touched instead of a full resolution image.
+ */
+class FlowField
+{
+    public:
+        FlowField();
+        virtual ~FlowField();
+
+        // clears all cells, the buffers are kept if the grid size is unchanged
+        void reset(const cv::Size &image_size, int pixel_step);
+
+        int rows() const;
+        int cols() const;
+        // number of cells
+        int size() const;
+        bool empty() const;
+        int getPixelStep() const;
+        cv::Size getImageSize() const;
+
+        int getIndex(int row, int col) const;
+        // cell of the grid point closest to pixel, -1 if it is outside the grid
+        int getIndex(const cv::Point2f &pixel) const;
+        // grid point of a cell
+        cv::Point getPixel(int index) const;
+
+        void setVector(int index, const cv::Point2f &start, const cv::Point2f &displacement);
+        // the point of the cell could not be tracked
+        void setLost(int index);
+
+        // tracked and not lost
+        bool isValid(int index) const;
+        // has a displacement, i.e. it was above min_vector_size
+        bool isMoving(int index) const;
+        // x, y, dx, dy; (-1, -1, 0, 0) for cells that are not valid
+        cv::Vec4d getVector(int index) const;
+
+        const std::vector<float> &getX() const;
+        const std::vector<float> &getY() const;
+        const std::vector<float> &getDX() const;
+        const std::vector<float> &getDY() const;
+        const std::vector<uchar> &getValid() const;
+
+    private:
+        cv::Size image_size_;
+        int pixel_step_;
+        int rows_;
+        int cols_;
+        std::vector<float> x_;
+        std::vector<float> y_;
+        std::vector<float> dx_;
+        std::vector<float> dy_;
+        std::vector<uchar> valid_;
+};
+#endif
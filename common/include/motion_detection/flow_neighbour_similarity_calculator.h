@@ -10,6 +10,7 @@
 #define FLOW_NEIGHBOUR_SIMILARITY_CALCULATOR_H
 
 #include <opencv2/core/core.hpp>
+#include <motion_detection/flow_field.h>
 
 class FlowNeighbourSimilarityCalculator
 {
@@ -17,7 +18,8 @@ class FlowNeighbourSimilarityCalculator
         FlowNeighbourSimilarityCalculator();
         virtual ~FlowNeighbourSimilarityCalculator();
 
-        void calculateNeighbourhoodSimilarity(const cv::Mat &vectors, cv::Mat &similarity, int pixel_step);
+        // similarity has one element per cell of vectors
+        void calculateNeighbourhoodSimilarity(const FlowField &vectors, cv::Mat &similarity);
 
         double getSimilarityMeasure(const cv::Vec4d &one, const cv::Vec4d &two);
 
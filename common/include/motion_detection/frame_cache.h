@@ -0,0 +1,62 @@
+/* frame_cache.h
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+#ifndef FRAME_CACHE_H_
+#define FRAME_CACHE_H_
+
+#include <opencv2/core/core.hpp>
+#include <motion_detection/image_preprocessor.h>
+
+struct CachedFrame
+{
+    cv::Mat image;
+    cv::Mat gray_image;
+    std::vector<cv::Mat> pyramid;
+};
+
+/**
+ * Ring buffer holding the frames of the sliding window. Every frame is
+ * converted to grayscale and its LK pyramid is built exactly once, when it
+ * is added. Slots are reused, so memory is bounded by the capacity.
+ */
+class FrameCache
+{
+    public:
+        FrameCache();
+        virtual ~FrameCache();
+
+        // capacity has to be at least 2 so that the previous frame is never overwritten
+        void setCapacity(int capacity);
+        void clear();
+
+        const CachedFrame &addFrame(const cv::Mat &image);
+
+        // converts image straight into the slot at the processing resolution;
+        // the RGB image is only kept when keep_colour is set
+        const CachedFrame &addFrame(const cv::Mat &image, ImagePreprocessor::PixelFormat format, int scale, bool keep_colour);
+
+        // index 0 is the oldest frame
+        const CachedFrame &at(int index) const;
+        const CachedFrame &back() const;
+        int size() const;
+        bool isFull() const;
+
+        void getPyramids(std::vector<std::vector<cv::Mat> > &pyramids) const;
+
+        static cv::Size windowSize();
+        static int maxLevel();
+
+    private:
+        CachedFrame &nextSlot();
+
+    private:
+        std::vector<CachedFrame> frames_;
+        int capacity_;
+        int start_;
+        int size_;
+};
+#endif
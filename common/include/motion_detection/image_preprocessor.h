@@ -0,0 +1,40 @@
+/* image_preprocessor.h
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+#ifndef IMAGE_PREPROCESSOR_H_
+#define IMAGE_PREPROCESSOR_H_
+
+#include <opencv2/core/core.hpp>
+
+class ImagePreprocessor
+{
+    public:
+        enum PixelFormat
+        {
+            MONO8,
+            BGR8,
+            RGB8,
+            YUYV,
+            UYVY
+        };
+
+        ImagePreprocessor();
+        virtual ~ImagePreprocessor();
+
+        /**
+         * Converts image to grayscale and downsamples it by scale (1 or 2)
+         * in a single pass over the input. gray is reused if it already has
+         * the right size.
+         */
+        static void toGray(const cv::Mat &image, PixelFormat format, int scale, cv::Mat &gray);
+
+        /**
+         * RGB copy of image at the processing resolution, for visualization
+         */
+        static void toRGB(const cv::Mat &image, PixelFormat format, int scale, cv::Mat &rgb);
+};
+#endif
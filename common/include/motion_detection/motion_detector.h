@@ -0,0 +1,61 @@
+/* motion_detector.h
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+#ifndef MOTION_DETECTOR_H_
+#define MOTION_DETECTOR_H_
+
+#include <opencv2/core/core.hpp>
+#include <motion_detection/pipeline_config.h>
+#include <motion_detection/frame_cache.h>
+#include <motion_detection/trajectory_tracker.h>
+#include <motion_detection/outlier_detector.h>
+#include <motion_detection/flow_clusterer.h>
+#include <motion_detection/optical_flow_visualizer.h>
+
+struct MotionDetectionResult
+{
+    // flow of the last frame step on the pixel_step grid
+    FlowField optical_flow_vectors;
+    // the tracks that span the whole window, in one contiguous buffer
+    TrackStore tracks;
+    std::vector<std::vector<cv::Point2f> > trajectory_subspace_vectors;
+    std::vector<std::vector<cv::Point2f> > clusters;
+    std::vector<cv::Rect> bounding_boxes;
+};
+
+/**
+ * Tracking, subspace fitting and clustering of one image stream, without
+ * any ROS dependency. track and detect touch disjoint state, so detect of
+ * one frame may run concurrently with track of the next one.
+ */
+class MotionDetector
+{
+    public:
+        // without egomotion the flow of consecutive frames is clustered directly
+        explicit MotionDetector(bool egomotion = true);
+        virtual ~MotionDetector();
+
+        void reset();
+
+        // returns false while the sliding window is still filling up
+        bool track(const PipelineConfig &config, const CachedFrame &frame, MotionDetectionResult &result);
+
+        // clusters and bounding boxes of everything that does not move with the background
+        void detect(const PipelineConfig &config, MotionDetectionResult &result);
+
+        // resets the tracker
+        void setEgomotion(bool egomotion);
+        bool isEgomotion() const;
+
+    private:
+        bool egomotion_;
+        TrajectoryTracker tracker_;
+        OutlierDetector od_;
+        FlowClusterer fc_;
+        OpticalFlowVisualizer ofv_;
+};
+#endif
@@ -9,6 +9,7 @@
 #define OPTICAL_FLOW_CALCULATOR_H_
 
 #include <opencv2/core/core.hpp>
+#include <motion_detection/flow_field.h>
 
 class OpticalFlowCalculator
 {
@@ -16,11 +17,13 @@ class OpticalFlowCalculator
         OpticalFlowCalculator();
         virtual ~OpticalFlowCalculator();
         
-        int calculateOpticalFlow(const cv::Mat &image1, const cv::Mat &image2, cv::Mat &optical_flow_vectors, int pixel_step, cv::Mat &comp, double min_vector_size);
+        int calculateOpticalFlow(const cv::Mat &image1, const cv::Mat &image2, FlowField &optical_flow_vectors, int pixel_step, double min_vector_size);
+        int calculateOpticalFlow(const cv::Mat &image1, const cv::Mat &image2, FlowField &optical_flow_vectors, int pixel_step, cv::Mat &comp, double min_vector_size);
 
-        int calculateOpticalFlowTrajectory(const std::vector<cv::Mat> &images, cv::Mat &optical_flow_vectors, std::vector<std::vector<cv::Point2f> > &trajectories, int pixel_step, cv::Mat &comp, double min_vector_size);
+        int calculateOpticalFlowTrajectory(const std::vector<cv::Mat> &images, FlowField &optical_flow_vectors, std::vector<std::vector<cv::Point2f> > &trajectories, int pixel_step, cv::Mat &comp, double min_vector_size);
+        int calculateOpticalFlowTrajectory(const std::vector<std::vector<cv::Mat> > &pyramids, FlowField &optical_flow_vectors, std::vector<std::vector<cv::Point2f> > &trajectories, int pixel_step, double min_vector_size);
 
-        int calculateCompensatedFlow(const cv::Mat &image1, const cv::Mat &image2, cv::Mat &optical_flow_vectors, int pixel_step);
+        int calculateCompensatedFlow(const cv::Mat &image1, const cv::Mat &image2, FlowField &optical_flow_vectors, int pixel_step);
 
         int superPixelFlow(const cv::Mat &image1, const cv::Mat &image2, cv::Mat &optical_flow_image, cv::Mat &optical_flow_vectors);
 
@@ -28,8 +31,11 @@ class OpticalFlowCalculator
 
         void drawMotionField(IplImage* imgU, IplImage* imgV, IplImage* imgMotion, int xSpace, int ySpace, float cutoff, int multiplier, CvScalar color);
 
-        void writeFlow(const cv::Mat &flow_vectors, const std::string &filename, int pixel_step);
+        void writeFlow(const FlowField &flow_vectors, const std::string &filename);
         void writeTrajectories(const std::vector<std::vector<cv::Point2f> > &trajectories, const std::string &filename);
+
+    private:
+        int calculateOpticalFlow(const cv::Mat &image1, const cv::Mat &image2, FlowField &optical_flow_vectors, int pixel_step, cv::Mat *comp, double min_vector_size);
 };
 
 #endif
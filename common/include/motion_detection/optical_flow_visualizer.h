@@ -10,6 +10,7 @@
 #define OPTICAL_FLOW_VISUALIZER_H_
 
 #include <opencv2/core/core.hpp>
+#include <motion_detection/flow_field.h>
 
 class OpticalFlowVisualizer
 {
@@ -17,11 +18,14 @@ class OpticalFlowVisualizer
         OpticalFlowVisualizer();
         virtual ~OpticalFlowVisualizer();
 
-        void showOpticalFlowVectors(const cv::Mat &original, cv::Mat &optical_flow_image, const cv::Mat &optical_flow_vectors, int pixel_step, cv::Scalar colour, double min_vector_size);        
+        void showOpticalFlowVectors(const cv::Mat &original, cv::Mat &optical_flow_image, const FlowField &optical_flow_vectors, cv::Scalar colour, double min_vector_size);        
         void showFlowClusters(const cv::Mat &original, cv::Mat &optical_flow_image, const std::vector<cv::Vec4d> &optical_flow_vectors, int pixel_step, cv::Scalar colour, double min_vector_size);        
-        void showFlowOutliers(const cv::Mat &original, cv::Mat &outlier_image, const cv::Mat &outlier_mask, const cv::Mat &optical_flow_vectors, int pixel_step, bool print);
+        // outlier_mask has one element per cell of optical_flow_vectors
+        void showFlowOutliers(const cv::Mat &original, cv::Mat &outlier_image, const FlowField &optical_flow_vectors, const cv::Mat &outlier_mask, bool print);
         std::vector<std::vector<cv::Point> > showClusterContours(const cv::Mat &original_image, cv::Mat &clusters_image, const std::vector<std::vector<cv::Point2f> > &clusters);
         std::vector<cv::Rect> showBoundingBoxes(const cv::Mat &original_image, cv::Mat &clusters_image, const std::vector<std::vector<cv::Point2f> > &clusters);
+        std::vector<cv::Rect> getBoundingBoxes(const std::vector<std::vector<cv::Point2f> > &clusters);
+        void drawBoundingBoxes(const cv::Mat &original_image, cv::Mat &clusters_image, const std::vector<cv::Rect> &rectangles);
 
 };
 #endif
@@ -9,6 +9,11 @@
 #define OUTLIER_DETECTOR_H_
 
 #include <opencv2/core/core.hpp>
+#include <motion_detection/track_store.h>
+#include <motion_detection/flow_field.h>
+#include <motion_detection/worker_team.h>
+#include <memory>
+#include <unordered_set>
 
 class OutlierDetector
 {
@@ -16,18 +21,58 @@ class OutlierDetector
         OutlierDetector();
         virtual ~OutlierDetector();
 
-        void findOutliers(const cv::Mat &optical_flow_vectors, cv::Mat &outlier_probabilities, bool include_zeros, int pixel_step, bool print);
-        void getOutlierVectors(const cv::Mat &optical_flow_vectors, const cv::Mat &outlier_probabilities, cv::Mat &outlier_vectors, int pixel_step);
+        // outlier_probabilities has one element per cell of the flow field
+        void findOutliers(const FlowField &optical_flow_vectors, cv::Mat &outlier_probabilities, bool include_zeros, bool print);
+        void getOutlierVectors(const FlowField &optical_flow_vectors, const cv::Mat &outlier_probabilities, FlowField &outlier_vectors);
+        // hypotheses are drawn from random streams derived from seed and the
+        // number of the fit, so a seed gives the same sequence of fits for any
+        // number of threads (0 for one per core). The fit stops once a sample of only inliers has been
+        // drawn with the given confidence, or after max_iterations.
+        void setRansacParameters(unsigned int seed, int num_threads, double confidence = 0.99, int max_iterations = 50);
+        // with warm start the next fit starts from the trajectories that were
+        // inliers of this one and only runs RANSAC if fewer than
+        // min_inlier_ratio of all trajectories fit that subspace
+        void setWarmStart(bool enabled, double min_inlier_ratio);
+        // fits the model on a spread-out subset of at most max_trajectories
+        // trajectories (0 for all of them) and then classifies all of them
+        void setMaxTrajectories(int max_trajectories);
+        // forgets the previous fit, e.g. after the tracks were reset
+        void reset();
         std::vector<std::vector<cv::Point2f> > fitSubspace(const std::vector<std::vector<cv::Point2f> > &trajectories, std::vector<cv::Point2f> &outlier_points, int num_motions, double sigma);
+        // fits the complete tracks in place, without copying them
+        std::vector<std::vector<cv::Point2f> > fitSubspace(const TrackStore &tracks, std::vector<cv::Point2f> &outlier_points, int num_motions, double sigma);
 
     private:
-        void createMask(const cv::Mat &optical_flow_vectors, const cv::Mat &values, cv::Mat &mask, bool include_zeros, int pixel_step, bool print);
-        void createAngleMatrix(const cv::Mat &optical_flow_vectors, cv::Mat &angle_matrix, int pixel_step);
-        void createMagnitudeMatrix(const cv::Mat &optical_flow_vectors, cv::Mat &magnitude_matrix, int pixel_step);
-        double getMedian(std::vector<double> vals, bool print);
+        // median of values and the largest deviation from it that is not an
+        // outlier; values is left in its original order
+        void getRobustLimits(const std::vector<float> &values, double &median, double &limit, bool print);
+        // reorders vals
+        double getMedian(std::vector<float> &vals);
+        // points is a column-major num_rows x num_trajectories matrix
+        void fitTrajectoryMatrix(const float *points, int num_rows, int num_trajectories, int num_motions, double sigma, std::vector<int> &outlier_columns, std::vector<int> &subspace_columns);
 
     private:
         std::vector<std::vector<double> > chi_square_table;
+        unsigned int seed_;
+        // fits since the seed was set
+        unsigned int num_fits_;
+        int num_threads_;
+        // started on the first fit that needs threads
+        std::unique_ptr<WorkerTeam> team_;
+        double confidence_;
+        int max_iterations_;
+        int max_trajectories_;
+        bool warm_start_;
+        double warm_start_min_inlier_ratio_;
+        // last points of the inliers of the previous fit
+        std::unordered_set<unsigned long long> previous_inliers_;
+        // buffers of findOutliers, kept between frames
+        cv::Mat angles_;
+        cv::Mat magnitudes_;
+        std::vector<int> cells_;
+        std::vector<float> angle_values_;
+        std::vector<float> magnitude_values_;
+        std::vector<float> deviations_;
         
 };
 #endif
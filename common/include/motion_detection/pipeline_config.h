@@ -0,0 +1,64 @@
+/* pipeline_config.h
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+#ifndef PIPELINE_CONFIG_H_
+#define PIPELINE_CONFIG_H_
+
+#include <string>
+
+/**
+ * Parameters of the detection pipeline. A snapshot is taken once per frame,
+ * so a reload never changes the parameters in the middle of a frame.
+ */
+struct PipelineConfig
+{
+    PipelineConfig();
+
+    // number of frames in the sliding window
+    int getTrajectorySize(bool egomotion) const;
+
+    int skip_frames;
+    int num_motions;
+    int pixel_step;
+    double min_vector_size;
+    // new tracks are seeded more than seed_border pixels inside the image and
+    // tracks converging onto one grid cell are merged unless merge_tracks is
+    // false; 0 and false track the full grid
+    int seed_border;
+    bool merge_tracks;
+    double distance_threshold;
+    // smaller clusters of outlier points or flow vectors are dropped
+    int min_cluster_size;
+    double angular_threshold;
+    // "connected" joins all points closer than distance_threshold, "density"
+    // only lets points with density_min_points such neighbours join clusters
+    std::string clustering_method;
+    int density_min_points;
+    // threads of the density-based clustering, 0 for one per core
+    int clustering_threads;
+    double sigma;
+    double residual_threshold;
+    // the same seed reproduces the same subspace fits for any thread count;
+    // the node seeds from the clock unless the ransac_seed parameter is set
+    int ransac_seed;
+    // 0 for one per core
+    int ransac_threads;
+    // the subspace fit stops early once it has drawn a sample of only
+    // inliers with this probability
+    double ransac_confidence;
+    int ransac_max_iterations;
+    // the subspace is fitted on at most this many trajectories spread over
+    // the image, 0 for all of them; every trajectory is still classified
+    int subspace_max_trajectories;
+    // start each subspace fit from the inliers of the previous window and
+    // only run RANSAC if fewer than this ratio still fit
+    bool subspace_warm_start;
+    double warm_start_min_inlier_ratio;
+    bool save_frames;
+    std::string frames_path;
+};
+#endif
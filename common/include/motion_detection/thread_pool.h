@@ -0,0 +1,66 @@
+/* thread_pool.h
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/**
+ * Fixed set of worker threads shared by several pipelines. Tasks are posted
+ * to strands: tasks of one strand run one at a time in the order they were
+ * posted, different strands run in parallel. Strands with pending work are
+ * served round-robin, one task per turn.
+ */
+class ThreadPool
+{
+    public:
+        // num_threads <= 0 uses one thread per core
+        explicit ThreadPool(int num_threads = 0);
+        // runs all pending tasks before joining the workers
+        virtual ~ThreadPool();
+
+        // capacity 0 means unbounded
+        int addStrand(size_t capacity = 0);
+
+        // returns false if the strand already holds capacity pending tasks
+        bool post(int strand, const std::function<void()> &task);
+
+        // blocks until the strand has no pending or running task
+        void waitIdle(int strand);
+        // blocks until none of the strands has a pending or running task,
+        // for strands that post to each other
+        void waitIdle(const std::vector<int> &strands);
+
+        int getNumThreads() const;
+
+    private:
+        struct Strand
+        {
+            std::deque<std::function<void()> > tasks;
+            size_t capacity;
+            bool running;
+        };
+
+        void workerLoop();
+
+    private:
+        std::vector<std::thread> workers_;
+        std::vector<Strand> strands_;
+        // strands that have pending tasks and are not running
+        std::deque<int> ready_;
+        std::mutex mutex_;
+        std::condition_variable work_available_;
+        std::condition_variable strand_idle_;
+        bool stopping_;
+};
+#endif
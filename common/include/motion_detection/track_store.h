@@ -0,0 +1,72 @@
+/* track_store.h
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+#ifndef TRACK_STORE_H_
+#define TRACK_STORE_H_
+
+#include <opencv2/core/core.hpp>
+
+/**
+ * Point tracks of the sliding window in one contiguous buffer. Every track
+ * is a column of 2 * window_size floats, x and y of the oldest point first,
+ * so the complete tracks can be used directly as the column-major trajectory
+ * matrix of the subspace fit. Tracks that are not yet window_size long only
+ * fill the first rows of their column, so their length takes the place of a
+ * validity mask, and separate x and y planes would have to be interleaved
+ * again for the fit.
+ */
+class TrackStore
+{
+    public:
+        TrackStore();
+        virtual ~TrackStore();
+
+        // removes all tracks
+        void reset(int window_size);
+
+        int size() const;
+        int getWindowSize() const;
+
+        // number of points of a track, at most window_size
+        int getLength(int track) const;
+        bool isComplete(int track) const;
+
+        // index 0 is the oldest point of the track
+        cv::Point2f getPoint(int track, int index) const;
+        cv::Point2f getLastPoint(int track) const;
+
+        void addTrack(const cv::Point2f &point);
+
+        // appends point, dropping the oldest point of a complete track
+        void extendTrack(int track, const cv::Point2f &point);
+
+        // overwrites track to with track from; used to compact the store
+        void moveTrack(int from, int to);
+
+        // keeps the first num_tracks tracks
+        void truncate(int num_tracks);
+
+        // tracks are kept oldest first, so the complete ones are a prefix
+        int getNumCompleteTracks() const;
+
+        // column-major 2 * window_size x size() matrix
+        const float *getData() const;
+
+        // replaces the content of tracks with the complete tracks. This is
+        // the one copy per frame: the tracker moves on to the next frame while
+        // the snapshot is fitted, and the fit maps the snapshot in place
+        void copyCompleteTracks(TrackStore &tracks) const;
+
+        void getTrajectories(std::vector<std::vector<cv::Point2f> > &trajectories) const;
+
+    private:
+        int window_size_;
+        int num_tracks_;
+        std::vector<float> points_;
+        std::vector<int> lengths_;
+};
+#endif
@@ -0,0 +1,70 @@
+/* trajectory_tracker.h
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+#ifndef TRAJECTORY_TRACKER_H_
+#define TRAJECTORY_TRACKER_H_
+
+#include <opencv2/core/core.hpp>
+#include <motion_detection/track_store.h>
+#include <motion_detection/flow_field.h>
+
+/**
+ * Keeps point tracks alive between frames and advances them by one LK step
+ * per new frame. Lost tracks are dropped and empty grid cells are re-seeded.
+ */
+class TrajectoryTracker
+{
+    public:
+        TrajectoryTracker();
+        virtual ~TrajectoryTracker();
+
+        // changing any of the parameters resets the tracker
+        void setParameters(int trajectory_size, int pixel_step, double min_vector_size);
+
+        // new tracks are only seeded more than seed_border pixels inside the
+        // image; with merge_tracks, tracks that converge onto one grid cell
+        // are merged into the oldest of them. 0 and false seed and keep tracks
+        // the way the full grid was re-tracked for every window
+        void setSeeding(int seed_border, bool merge_tracks);
+        void reset();
+
+        // optical_flow_vectors receives the flow of the last step only
+        int addFrame(const cv::Mat &image, FlowField &optical_flow_vectors);
+
+        // pyramid as built by FrameCache; it is kept until the next frame is added
+        int addFrame(const std::vector<cv::Mat> &pyramid, FlowField &optical_flow_vectors);
+
+        // last trajectory_size positions of tracks that span the whole window
+        void getTrajectories(std::vector<std::vector<cv::Point2f> > &trajectories) const;
+
+        // copies the tracks that span the whole window into tracks
+        void getTracks(TrackStore &tracks) const;
+
+        bool isWindowFull() const;
+
+    private:
+        bool isInsideBorder(const cv::Point2f &point, int border) const;
+        void seedTracks();
+
+    private:
+        int trajectory_size_;
+        int pixel_step_;
+        double min_vector_size_;
+        int seed_border_;
+        bool merge_tracks_;
+        int num_frames_;
+        cv::Size image_size_;
+
+        std::vector<cv::Mat> previous_pyramid_;
+        std::vector<cv::Point2f> previous_points_;
+        std::vector<cv::Point2f> next_points_;
+        std::vector<uchar> status_;
+        std::vector<float> err_;
+        TrackStore tracks_;
+        std::vector<int> cell_owner_;
+};
+#endif
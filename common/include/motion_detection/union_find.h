@@ -0,0 +1,65 @@
+/* union_find.h
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+#ifndef UNION_FIND_H_
+#define UNION_FIND_H_
+
+#include <vector>
+#include <atomic>
+
+/**
+ * Disjoint sets of the elements 0..n-1 with union by size and path
+ * halving, so labelling connected components is close to linear.
+ */
+class UnionFind
+{
+    public:
+        UnionFind();
+        virtual ~UnionFind();
+
+        // every element in a set of its own
+        void reset(int num_elements);
+
+        int size() const;
+
+        // representative of the set of element
+        int find(int element);
+
+        // merges the sets of a and b
+        void unite(int a, int b);
+
+    private:
+        std::vector<int> parents_;
+        std::vector<int> sizes_;
+};
+
+/**
+ * Disjoint sets that several threads can find and unite at the same time.
+ * Roots are linked to the smaller root with compare-and-swap, so the sets
+ * only depend on which pairs were united, not on the order.
+ */
+class AtomicUnionFind
+{
+    public:
+        AtomicUnionFind();
+        virtual ~AtomicUnionFind();
+
+        // every element in a set of its own; not thread-safe
+        void reset(int num_elements);
+
+        int size() const;
+
+        // representative of the set of element
+        int find(int element);
+
+        // merges the sets of a and b
+        void unite(int a, int b);
+
+    private:
+        std::vector<std::atomic<int> > parents_;
+};
+#endif
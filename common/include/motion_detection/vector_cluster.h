@@ -10,6 +10,11 @@
 
 #include <opencv2/core/core.hpp>
 
+/**
+ * Flow vectors (x, y, dx, dy) grouped together. The unit direction of each
+ * vector is stored when it is added, and the sums behind the centroid,
+ * bounding box and mean orientation are updated then as well.
+ */
 class VectorCluster
 {
     public:
@@ -17,25 +22,39 @@ class VectorCluster
         virtual ~VectorCluster();
 
         void addVector(const cv::Vec4d &vector);
-        double getClosestDistance(const cv::Vec4d &vector);
-        double getClosestOrientation(const cv::Vec4d &vector);
-        cv::Point2f getCentroid();
-        double getMeanOrientation();
+        double getClosestDistance(const cv::Vec4d &vector) const;
+        // smallest angle in radians between vector and a vector of the cluster
+        double getClosestOrientation(const cv::Vec4d &vector) const;
+        cv::Point2f getCentroid() const;
+        // direction of the sum of the unit directions, in [0, 2 * pi). For a
+        // cluster on both sides of 0 this differs from the mean of the angles,
+        // which pointed away from all of its vectors, and so does the arrow of
+        // getMeanVector
+        double getMeanOrientation() const;
         
-        std::vector<cv::Vec4d> getCluster();
-        std::vector<cv::Point2f> getClusterPoints();
-        std::vector<cv::Vec4d> getMeanVector();
-        int size();
+        const std::vector<cv::Vec4d> &getCluster() const;
+        const std::vector<cv::Point2f> &getClusterPoints() const;
+        std::vector<cv::Vec4d> getMeanVector() const;
+        int size() const;
 
 
     private:
-        double getDistance(const cv::Vec4d &one, const cv::Vec4d &two);
-        double getAngularDistance(const cv::Vec4d &one, const cv::Vec4d &two);
-        double getAngle(const cv::Vec4d &vector);
-        void getMinMax(double &min_x, double &max_x, double &min_y, double &max_y);
+        // unit direction, (1, 0) for a zero vector
+        cv::Point2d getDirection(const cv::Vec4d &vector) const;
+        void getMinMax(double &min_x, double &max_x, double &min_y, double &max_y) const;
 
 
     private:
         std::vector<cv::Vec4d> cluster_;
+        std::vector<cv::Point2f> cluster_points_;
+        std::vector<cv::Point2d> directions_;
+        double x_sum_;
+        double y_sum_;
+        double direction_x_sum_;
+        double direction_y_sum_;
+        double min_x_;
+        double max_x_;
+        double min_y_;
+        double max_y_;
 };
 #endif
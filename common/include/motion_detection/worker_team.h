@@ -0,0 +1,48 @@
+/* worker_team.h
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+#ifndef WORKER_TEAM_H_
+#define WORKER_TEAM_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/**
+ * Threads that run several rounds of one parallel computation. They are
+ * started once and wait between rounds, so an algorithm with many short
+ * parallel steps does not start threads for each of them.
+ */
+class WorkerTeam
+{
+    public:
+        // the calling thread is one of the num_threads members
+        explicit WorkerTeam(int num_threads);
+        virtual ~WorkerTeam();
+
+        int size() const;
+
+        // calls task(member) for every member, member 0 on the calling
+        // thread, and returns once all of them are done
+        void run(const std::function<void(int)> &task);
+
+    private:
+        void workerLoop(int member);
+
+    private:
+        std::vector<std::thread> workers_;
+        std::mutex mutex_;
+        std::condition_variable round_started_;
+        std::condition_variable round_finished_;
+        const std::function<void(int)> *task_;
+        unsigned long round_;
+        int num_running_;
+        bool stopping_;
+};
+#endif
@@ -0,0 +1,420 @@
+/* density_clusterer.cpp
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include <motion_detection/density_clusterer.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+/**
+ * Calls function on blocks of [0, count) from the first num_threads members
+ * of team, or on the calling thread for a single thread. Blocks are handed
+ * out as members become free, so dense parts of the image do not hold up a
+ * single thread.
+ */
+void runBlocks(WorkerTeam *team, int num_threads, int count, int block_size, const std::function<void(int, int)> &function)
+{
+    std::atomic<int> next_block(0);
+    std::function<void(int)> task = [&](int member)
+    {
+        if (member >= num_threads)
+        {
+            return;
+        }
+        while (true)
+        {
+            int begin = next_block.fetch_add(block_size);
+            if (begin >= count)
+            {
+                return;
+            }
+            function(begin, std::min(begin + block_size, count));
+        }
+    };
+    if (num_threads == 1)
+    {
+        task(0);
+    }
+    else
+    {
+        team->run(task);
+    }
+}
+
+DensityClusterer::DensityClusterer() : num_threads_(0), distance_threshold_(0.0), min_cosine_(-2.0), min_points_(1),
+                                       use_directions_(false), cells_connected_(false), grid_cols_(0), grid_rows_(0), grid_bins_(1)
+{
+}
+
+DensityClusterer::~DensityClusterer()
+{
+}
+
+void DensityClusterer::setNumThreads(int num_threads)
+{
+    if (num_threads != num_threads_)
+    {
+        team_.reset();
+    }
+    num_threads_ = num_threads;
+}
+
+int DensityClusterer::cluster(const std::vector<cv::Point2f> &points, const std::vector<cv::Point2f> &directions,
+                              double distance_threshold, double min_cosine, int min_points, std::vector<int> &labels)
+{
+    labels.assign(points.size(), -1);
+    if (points.empty())
+    {
+        return 0;
+    }
+    distance_threshold_ = distance_threshold;
+    min_cosine_ = min_cosine;
+    min_points_ = std::max(min_points, 1);
+    use_directions_ = !directions.empty();
+    buildGrid(points, directions);
+
+    int num_points = points.size();
+    int num_cells = grid_cols_ * grid_rows_ * grid_bins_;
+    core_.assign(num_points, 0);
+    borders_.assign(num_points, -1);
+    sets_.reset(num_points);
+
+    // threads do not pay off for small sets
+    int min_points_per_thread = 2000;
+    int num_threads = num_threads_ > 0 ? num_threads_ : std::thread::hardware_concurrency();
+    num_threads = std::max(1, std::min(num_threads, num_points / min_points_per_thread));
+    int block_size = 256;
+
+    // the threads are kept from call to call and only replaced by a larger team
+    if (num_threads > 1 && (!team_ || team_->size() < num_threads))
+    {
+        team_.reset(new WorkerTeam(num_threads));
+    }
+    runBlocks(team_.get(), num_threads, num_points, block_size, std::bind(&DensityClusterer::findCorePoints, this, std::placeholders::_1, std::placeholders::_2));
+    runBlocks(team_.get(), num_threads, num_cells, block_size, std::bind(&DensityClusterer::joinCorePoints, this, std::placeholders::_1, std::placeholders::_2));
+    runBlocks(team_.get(), num_threads, num_points, block_size, std::bind(&DensityClusterer::assignBorderPoints, this, std::placeholders::_1, std::placeholders::_2));
+
+    // clusters in the order of their first point
+    int num_clusters = 0;
+    cluster_index_.assign(num_points, -1);
+    for (int i = 0; i < num_points; i++)
+    {
+        int k = positions_[i];
+        int core_point = core_[k] ? k : borders_[k];
+        if (core_point == -1)
+        {
+            continue;
+        }
+        int root = sets_.find(core_point);
+        if (cluster_index_[root] == -1)
+        {
+            cluster_index_[root] = num_clusters;
+            num_clusters++;
+        }
+        labels[i] = cluster_index_[root];
+    }
+    return num_clusters;
+}
+
+void DensityClusterer::buildGrid(const std::vector<cv::Point2f> &points, const std::vector<cv::Point2f> &directions)
+{
+    int num_points = points.size();
+    float min_x = std::numeric_limits<float>::max();
+    float min_y = std::numeric_limits<float>::max();
+    float max_x = -std::numeric_limits<float>::max();
+    float max_y = -std::numeric_limits<float>::max();
+    for (int i = 0; i < num_points; i++)
+    {
+        min_x = std::min(min_x, points[i].x);
+        min_y = std::min(min_y, points[i].y);
+        max_x = std::max(max_x, points[i].x);
+        max_y = std::max(max_y, points[i].y);
+    }
+
+    // directions in the same bin are less than the angular threshold apart
+    double angular_threshold = use_directions_ ? std::acos(std::max(std::min(min_cosine_, 1.0), -1.0)) : M_PI;
+    grid_bins_ = 1;
+    if (angular_threshold > 0.0 && angular_threshold < M_PI)
+    {
+        grid_bins_ = std::min((int)std::ceil(2 * M_PI / (0.999 * angular_threshold)), 360);
+    }
+    double bin_size = 2 * M_PI / grid_bins_;
+
+    // with a cell diagonal of distance_threshold all points of a cell are
+    // neighbours; the cells are made larger if the grid would be much
+    // bigger than the number of points
+    double cell_size = distance_threshold_ > 0.0 ? 0.999 * distance_threshold_ / std::sqrt(2.0) : 1.0;
+    bool bins_connected = !use_directions_ || min_cosine_ < -1.0 || (grid_bins_ > 1 && bin_size < angular_threshold);
+    cells_connected_ = distance_threshold_ > 0.0 && bins_connected;
+    double max_cells = 4.0 * num_points + 4096.0;
+    while (((max_x - min_x) / cell_size + 1.0) * ((max_y - min_y) / cell_size + 1.0) * grid_bins_ > max_cells)
+    {
+        cell_size *= 2.0;
+        cells_connected_ = false;
+    }
+    grid_cols_ = (int)((max_x - min_x) / cell_size) + 1;
+    grid_rows_ = (int)((max_y - min_y) / cell_size) + 1;
+
+    // cells that can hold a neighbour
+    offsets_.clear();
+    int radius = distance_threshold_ > 0.0 ? (int)std::ceil(distance_threshold_ / cell_size) : 0;
+    int bin_radius = grid_bins_ > 1 ? (int)std::ceil(angular_threshold / bin_size) : 0;
+    int first_bin = -bin_radius;
+    int last_bin = bin_radius;
+    if (2 * bin_radius + 1 >= grid_bins_)
+    {
+        // every bin once
+        first_bin = 0;
+        last_bin = grid_bins_ - 1;
+    }
+    for (int bin = first_bin; bin <= last_bin; bin++)
+    {
+        for (int row = -radius; row <= radius; row++)
+        {
+            for (int col = -radius; col <= radius; col++)
+            {
+                double gap_x = std::max(std::abs(col) - 1, 0) * cell_size;
+                double gap_y = std::max(std::abs(row) - 1, 0) * cell_size;
+                if (gap_x * gap_x + gap_y * gap_y < distance_threshold_ * distance_threshold_ || (col == 0 && row == 0))
+                {
+                    CellOffset offset;
+                    offset.col = col;
+                    offset.row = row;
+                    offset.bin = bin;
+                    offsets_.push_back(offset);
+                }
+            }
+        }
+    }
+
+    // counting sort of the points by cell
+    int num_cells = grid_cols_ * grid_rows_ * grid_bins_;
+    std::vector<int> cells(num_points);
+    cell_starts_.assign(num_cells + 1, 0);
+    for (int i = 0; i < num_points; i++)
+    {
+        int col = std::min((int)((points[i].x - min_x) / cell_size), grid_cols_ - 1);
+        int row = std::min((int)((points[i].y - min_y) / cell_size), grid_rows_ - 1);
+        int bin = 0;
+        if (grid_bins_ > 1)
+        {
+            double angle = std::atan2(directions[i].y, directions[i].x);
+            if (angle < 0.0)
+            {
+                angle += 2 * M_PI;
+            }
+            bin = std::min((int)(angle / bin_size), grid_bins_ - 1);
+        }
+        cells[i] = (bin * grid_rows_ + row) * grid_cols_ + col;
+        cell_starts_[cells[i] + 1]++;
+    }
+    for (int c = 0; c < num_cells; c++)
+    {
+        cell_starts_[c + 1] += cell_starts_[c];
+    }
+    cells_.resize(num_points);
+    positions_.resize(num_points);
+    points_.resize(num_points);
+    directions_.resize(use_directions_ ? num_points : 0);
+    std::vector<int> fill(cell_starts_.begin(), cell_starts_.end() - 1);
+    for (int i = 0; i < num_points; i++)
+    {
+        int k = fill[cells[i]]++;
+        cells_[k] = cells[i];
+        positions_[i] = k;
+        points_[k] = points[i];
+        if (use_directions_)
+        {
+            directions_[k] = directions[i];
+        }
+    }
+}
+
+bool DensityClusterer::isNeighbour(int a, int b) const
+{
+    double x_diff = points_[a].x - points_[b].x;
+    double y_diff = points_[a].y - points_[b].y;
+    if (x_diff * x_diff + y_diff * y_diff >= distance_threshold_ * distance_threshold_)
+    {
+        return false;
+    }
+    return !use_directions_ || directions_[a].x * directions_[b].x + directions_[a].y * directions_[b].y > min_cosine_;
+}
+
+bool DensityClusterer::comesBefore(int a, int b) const
+{
+    if (points_[a].y != points_[b].y) return points_[a].y < points_[b].y;
+    if (points_[a].x != points_[b].x) return points_[a].x < points_[b].x;
+    if (!use_directions_) return false;
+    if (directions_[a].y != directions_[b].y) return directions_[a].y < directions_[b].y;
+    return directions_[a].x < directions_[b].x;
+}
+
+int DensityClusterer::getNeighbourCell(int cell, const CellOffset &offset) const
+{
+    int col = cell % grid_cols_ + offset.col;
+    int row = (cell / grid_cols_) % grid_rows_ + offset.row;
+    if (col < 0 || row < 0 || col >= grid_cols_ || row >= grid_rows_)
+    {
+        return -1;
+    }
+    int bin = (cell / (grid_cols_ * grid_rows_) + offset.bin + grid_bins_) % grid_bins_;
+    return (bin * grid_rows_ + row) * grid_cols_ + col;
+}
+
+void DensityClusterer::findCorePoints(int begin, int end)
+{
+    for (int k = begin; k < end; k++)
+    {
+        int cell = cells_[k];
+        if (cells_connected_ && cell_starts_[cell + 1] - cell_starts_[cell] >= min_points_)
+        {
+            core_[k] = 1;
+            continue;
+        }
+        int count = 0;
+        for (int o = 0; o < offsets_.size() && count < min_points_; o++)
+        {
+            int ncell = getNeighbourCell(cell, offsets_[o]);
+            if (ncell == -1)
+            {
+                continue;
+            }
+            for (int j = cell_starts_[ncell]; j < cell_starts_[ncell + 1] && count < min_points_; j++)
+            {
+                if (isNeighbour(k, j))
+                {
+                    count++;
+                }
+            }
+        }
+        core_[k] = (count >= min_points_);
+    }
+}
+
+void DensityClusterer::joinCorePoints(int begin, int end)
+{
+    for (int cell = begin; cell < end; cell++)
+    {
+        int first_core = -1;
+        for (int k = cell_starts_[cell]; k < cell_starts_[cell + 1]; k++)
+        {
+            if (!core_[k])
+            {
+                continue;
+            }
+            if (cells_connected_)
+            {
+                // the core points of a cell are neighbours
+                if (first_core == -1)
+                {
+                    first_core = k;
+                }
+                else
+                {
+                    sets_.unite(first_core, k);
+                }
+                continue;
+            }
+            // every pair once, from the point that comes first
+            for (int o = 0; o < offsets_.size(); o++)
+            {
+                int ncell = getNeighbourCell(cell, offsets_[o]);
+                if (ncell == -1)
+                {
+                    continue;
+                }
+                for (int j = std::max(cell_starts_[ncell], k + 1); j < cell_starts_[ncell + 1]; j++)
+                {
+                    if (core_[j] && isNeighbour(k, j))
+                    {
+                        sets_.unite(k, j);
+                    }
+                }
+            }
+        }
+        if (first_core == -1)
+        {
+            continue;
+        }
+        // with connected cells, one close pair of core points joins two cells
+        for (int o = 0; o < offsets_.size(); o++)
+        {
+            int ncell = getNeighbourCell(cell, offsets_[o]);
+            if (ncell == -1)
+            {
+                continue;
+            }
+            if (ncell <= cell)
+            {
+                continue;
+            }
+            bool joined = false;
+            for (int j = cell_starts_[ncell]; j < cell_starts_[ncell + 1] && !joined; j++)
+            {
+                if (!core_[j])
+                {
+                    continue;
+                }
+                if (sets_.find(first_core) == sets_.find(j))
+                {
+                    break;
+                }
+                for (int k = first_core; k < cell_starts_[cell + 1] && !joined; k++)
+                {
+                    if (core_[k] && isNeighbour(k, j))
+                    {
+                        sets_.unite(k, j);
+                        joined = true;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void DensityClusterer::assignBorderPoints(int begin, int end)
+{
+    for (int k = begin; k < end; k++)
+    {
+        if (core_[k])
+        {
+            continue;
+        }
+        int cell = cells_[k];
+        int closest = -1;
+        double closest_distance = std::numeric_limits<double>::max();
+        for (int o = 0; o < offsets_.size(); o++)
+        {
+            int ncell = getNeighbourCell(cell, offsets_[o]);
+            if (ncell == -1)
+            {
+                continue;
+            }
+            for (int j = cell_starts_[ncell]; j < cell_starts_[ncell + 1]; j++)
+            {
+                if (!core_[j] || !isNeighbour(k, j))
+                {
+                    continue;
+                }
+                double x_diff = points_[k].x - points_[j].x;
+                double y_diff = points_[k].y - points_[j].y;
+                double distance = x_diff * x_diff + y_diff * y_diff;
+                if (distance < closest_distance || (distance == closest_distance && comesBefore(j, closest)))
+                {
+                    closest_distance = distance;
+                    closest = j;
+                }
+            }
+        }
+        borders_[k] = closest;
+    }
+}
@@ -7,6 +7,8 @@
  */
 
 #include <motion_detection/egomotion_compensator.h>
+#include <iostream>
+#include <cmath>
 
 EgomotionCompensator::EgomotionCompensator()
 {
@@ -16,32 +18,28 @@ EgomotionCompensator::~EgomotionCompensator()
 {
 }
 
-void EgomotionCompensator::calculateCompensatedVectors(const cv::Mat &optical_flow_vectors, const std::vector<double> &odom, cv::Mat &compensated_vectors, int pixel_step)
+void EgomotionCompensator::calculateCompensatedVectors(const FlowField &optical_flow_vectors, const std::vector<double> &odom, FlowField &compensated_vectors)
 {
     double foe_x, foe_y;
     getFOE(odom, foe_x, foe_y);
+
+    cv::Size image_size = optical_flow_vectors.getImageSize();
+    compensated_vectors.reset(image_size, optical_flow_vectors.getPixelStep());
     
-    for (int i = 0; i < optical_flow_vectors.rows; i = i + pixel_step)
+    for (int i = 0; i < optical_flow_vectors.size(); i++)
     {
-        for (int j = 0; j < optical_flow_vectors.cols; j = j + pixel_step)
+        if (optical_flow_vectors.isValid(i))
         {
-                cv::Vec4d elem = optical_flow_vectors.at<cv::Vec4d>(i, j);
-                if (elem[0] != -1.0)
-                {
-                    double expected = getExpectedOrientation(elem[0], elem[1], foe_x, foe_y);
-                    double seen = atan2(elem[3], elem[2]);
+            cv::Vec4d elem = optical_flow_vectors.getVector(i);
+            double expected = getExpectedOrientation(elem[0], elem[1], foe_x, foe_y, image_size.width, image_size.height);
+            double seen = atan2(elem[3], elem[2]);
 
-                    std::cout << "expected: " << expected << " seen: " << seen << std::endl;
+            std::cout << "expected: " << expected << " seen: " << seen << std::endl;
 
-                    if (abs(expected - seen) > 0.1)
-                    {
-                        cv::Vec4d &elem_copy = compensated_vectors.at<cv::Vec4d>(i, j);
-                        elem_copy[0] = elem[0];
-                        elem_copy[1] = elem[1];
-                        elem_copy[2] = elem[2];
-                        elem_copy[3] = elem[3];
-                    }
-                }
+            if (abs(expected - seen) > 0.1)
+            {
+                compensated_vectors.setVector(i, cv::Point2f(elem[0], elem[1]), cv::Point2f(elem[2], elem[3]));
+            }
         }
     }
 }
@@ -38,9 +38,9 @@ void ExpectedFlowCalculator::setCameraParameters(cv::Mat camera_matrix, cv::Mat
 void ExpectedFlowCalculator::calculateExpectedFlow(PointCloud frame, 
                                                                           std::vector<double> odom,    
                                                                           cv::Mat &projected_image2,
-                                                                          cv::Mat &expected_flow_vectors,
-                                                                          int pixel_step)
+                                                                          FlowField &expected_flow_vectors)
 {
+    int pixel_step = expected_flow_vectors.getPixelStep();
 
     if (odom[2] == 0.0)
     {
@@ -109,16 +109,10 @@ void ExpectedFlowCalculator::calculateExpectedFlow(PointCloud frame,
 
         if ((int)start_point.x % pixel_step != 0 || (int)start_point.y % pixel_step != 0)
             continue;
-        cv::Vec4d &elem = expected_flow_vectors.at<cv::Vec4d> ((int)start_point.y, (int)start_point.x);
-        float x_diff = end_point.x - start_point.x;
-        float y_diff = end_point.y - start_point.y;
-        elem[0] = start_point.x;
-        elem[1] = start_point.y;
-        elem[2] = x_diff;
-        elem[3] = y_diff;
-        
-      //  elem[2] = atan2(y_diff, x_diff);
-      //  elem[3] = sqrt(x_diff*x_diff + y_diff*y_diff);
+        int index = expected_flow_vectors.getIndex(start_point);
+        if (index == -1)
+            continue;
+        expected_flow_vectors.setVector(index, start_point, end_point - start_point);
     }
 }
 
@@ -8,11 +8,13 @@
 
 #include <motion_detection/flow_clusterer.h>
 #include <motion_detection/vector_cluster.h>
-#include <motion_detection/point_cluster.h>
-#include <opencv2/flann/flann_base.hpp>
-#include <opencv2/features2d/features2d.hpp>
+#include <motion_detection/union_find.h>
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+#include <limits>
 
-FlowClusterer::FlowClusterer()
+FlowClusterer::FlowClusterer() : num_clusters_(10), batch_size_(100), num_batches_(5)
 {
 }
 
@@ -20,90 +22,188 @@ FlowClusterer::~FlowClusterer()
 {
 }
 
-cv::Mat FlowClusterer::clusterFlowVectors(const cv::Mat &flow_vectors)
+cv::Mat FlowClusterer::clusterFlowVectors(const FlowField &flow_vectors)
 {
-    //std::cout << "started" << std::endl;
+    std::vector<int> labels;
+    return clusterFlowVectors(flow_vectors, labels);
+}
 
-//    std::cout << "hmm 1" << flow_vectors.rows << ", " << flow_vectors.cols << std::endl;
-    cv::Mat samples = cv::Mat::zeros(flow_vectors.rows * flow_vectors.cols, 2, CV_32F);    
-  //  std::cout << "hmm " << std::endl;
-    int num_samples = 0;
-    for (int i = 0; i < flow_vectors.rows; i = i + 20)
+cv::Mat FlowClusterer::clusterFlowVectors(const FlowField &flow_vectors, std::vector<int> &labels)
+{
+    labels.assign(flow_vectors.size(), -1);
+    samples_.clear();
+    sample_cells_.clear();
+    const std::vector<float> &x = flow_vectors.getX();
+    const std::vector<float> &y = flow_vectors.getY();
+    for (int i = 0; i < flow_vectors.size(); i++)
     {
-        for (int j = 0; j < flow_vectors.cols; j = j + 20)
+        if (flow_vectors.isMoving(i))
         {
-            //std::cout << "yep " << std::endl;
-           // std::cout << flow_vectors.at<cv::Vec4d>(i,j)[3] << std::endl;
-            if(flow_vectors.at<cv::Vec4d>(i,j)[3] > 0.0)
+            samples_.push_back(cv::Point2f(x[i], y[i]));
+            sample_cells_.push_back(i);
+        }
+    }
+    if (samples_.empty())
+    {
+        return cv::Mat(0, 2, CV_32F);
+    }
+
+    // older frames weigh less, so that the centres follow the motion
+    for (int c = 0; c < center_counts_.size(); c++)
+    {
+        center_counts_.at(c) *= 0.5;
+    }
+    addCenters(num_clusters_);
+
+    std::uniform_int_distribution<int> sample_distribution(0, samples_.size() - 1);
+    std::vector<int> batch_hits(centers_.size());
+    for (int b = 0; b < num_batches_; b++)
+    {
+        std::fill(batch_hits.begin(), batch_hits.end(), 0);
+        int farthest = -1;
+        double farthest_distance = -1.0;
+        for (int s = 0; s < batch_size_; s++)
+        {
+            int k = sample_distribution(rng_);
+            double squared_distance;
+            int c = getClosestCenter(samples_.at(k), squared_distance);
+            center_counts_.at(c) += 1.0;
+            double rate = 1.0 / center_counts_.at(c);
+            centers_.at(c).x += rate * (samples_.at(k).x - centers_.at(c).x);
+            centers_.at(c).y += rate * (samples_.at(k).y - centers_.at(c).y);
+            batch_hits.at(c)++;
+            if (squared_distance > farthest_distance)
             {
-               // std::cout << "reached here (" << i <<", " << j << "), "<< num_samples << ": ";          
-                for (int f = 0; f < 2; f++)
-                {
-                    samples.at<float>(num_samples, f) = flow_vectors.at<cv::Vec4d>(i,j)[f];
-                    //std::cout << samples.at<float>(num_samples, f) << ", ";
-                }
-                //std::cout << std::endl;
-                num_samples++;
+                farthest_distance = squared_distance;
+                farthest = k;
+            }
+        }
+        // a centre without samples, e.g. of an object that stopped, moves to
+        // the worst fitted sample of the batch
+        for (int c = 0; c < centers_.size() && farthest != -1; c++)
+        {
+            if (batch_hits.at(c) == 0)
+            {
+                centers_.at(c) = samples_.at(farthest);
+                center_counts_.at(c) = 1.0;
+                farthest = -1;
             }
         }
     }
-    cvflann::KMeansIndexParams kmeans_params(3000, 100, cvflann::FLANN_CENTERS_KMEANSPP);
- //   std::cout << "done collecting samples" << std::endl;
 
-    samples = samples.rowRange(cv::Range(0,num_samples));
-    cvflann::Matrix<float> samplesMatrix((float*)samples.data, samples.rows, samples.cols);
-//    std::cout << "done setting samples matrix" << std::endl;
-    cv::Mat centers(10, 2, CV_32F);
-    cvflann::Matrix<float> centersMatrix((float*)centers.data, centers.rows, centers.cols);
+    cv::Mat centers(centers_.size(), 2, CV_32F);
+    for (int c = 0; c < centers_.size(); c++)
+    {
+        centers.at<float>(c, 0) = centers_.at(c).x;
+        centers.at<float>(c, 1) = centers_.at(c).y;
+    }
+    for (int s = 0; s < samples_.size(); s++)
+    {
+        double squared_distance;
+        labels.at(sample_cells_.at(s)) = getClosestCenter(samples_.at(s), squared_distance);
+    }
+    return centers;
+}
 
+void FlowClusterer::resetCenters()
+{
+    centers_.clear();
+    center_counts_.clear();
+}
 
-   // std::cout << "started clustering " << std::endl;
-    int num_clusters = cvflann::hierarchicalClustering<cvflann::L2<float> >(samplesMatrix, centersMatrix, kmeans_params);
-   // std::cout << "finished clustering " << std::endl;
+void FlowClusterer::addCenters(int num_centers)
+{
+    if (centers_.size() >= num_centers)
+    {
+        return;
+    }
+    // squared distance of every sample to its closest centre
+    std::vector<double> distances(samples_.size(), std::numeric_limits<double>::max());
+    for (int s = 0; s < samples_.size() && !centers_.empty(); s++)
+    {
+        getClosestCenter(samples_.at(s), distances.at(s));
+    }
+    while (centers_.size() < num_centers)
+    {
+        int next = 0;
+        if (centers_.empty())
+        {
+            next = std::uniform_int_distribution<int>(0, samples_.size() - 1)(rng_);
+        }
+        else
+        {
+            // pick samples with probability proportional to their distance
+            double total = 0.0;
+            for (int s = 0; s < samples_.size(); s++)
+            {
+                total += distances.at(s);
+            }
+            if (total == 0.0)
+            {
+                // every sample is on a centre already
+                break;
+            }
+            double target = std::uniform_real_distribution<double>(0.0, total)(rng_);
+            while (next < samples_.size() - 1 && target >= distances.at(next))
+            {
+                target -= distances.at(next);
+                next++;
+            }
+        }
+        const cv::Point2f &center = samples_.at(next);
+        centers_.push_back(center);
+        center_counts_.push_back(1.0);
+        for (int s = 0; s < samples_.size(); s++)
+        {
+            double x_diff = samples_.at(s).x - center.x;
+            double y_diff = samples_.at(s).y - center.y;
+            distances.at(s) = std::min(distances.at(s), x_diff * x_diff + y_diff * y_diff);
+        }
+    }
+}
 
-    centers = centers.rowRange(cv::Range(0, num_clusters));
-    /*
-    std::cout << "centers: " << std::endl;
-    for(int i = 0; i < num_clusters; i++)
+int FlowClusterer::getClosestCenter(const cv::Point2f &point, double &squared_distance) const
+{
+    int closest = -1;
+    squared_distance = std::numeric_limits<double>::max();
+    for (int c = 0; c < centers_.size(); c++)
     {
-        for (int j = 0; j < centersMatrix.cols; j++)
+        double x_diff = point.x - centers_[c].x;
+        double y_diff = point.y - centers_[c].y;
+        double distance = x_diff * x_diff + y_diff * y_diff;
+        if (distance < squared_distance)
         {
-            std::cout << centersMatrix[i][j] << ", ";
+            squared_distance = distance;
+            closest = c;
         }
-        std::cout << std::endl;
     }
-    std::cout <<"num_clusters: " << num_clusters << std::endl;
-    */
-    return centers;
+    return closest;
 }
 
-std::vector<cv::Point2f> FlowClusterer::getClustersCenters(const cv::Mat &flow_vectors, int pixel_step, double distance_threshold, double angular_threshold)
+std::vector<cv::Point2f> FlowClusterer::getClustersCenters(const FlowField &flow_vectors, double distance_threshold, double angular_threshold)
 {
     std::vector<VectorCluster> clusters;
-    for (int i = 0; i < flow_vectors.rows; i = i + pixel_step)
+    for (int i = 0; i < flow_vectors.size(); i++)
     {
-        for (int j = 0; j < flow_vectors.cols; j = j + pixel_step)
+        if (flow_vectors.isMoving(i))
         {
-            cv::Vec4d vec = flow_vectors.at<cv::Vec4d>(i, j);
-            if (std::abs(vec[2]) > 0.0 || std::abs(vec[3]) > 0.0)
+            cv::Vec4d vec = flow_vectors.getVector(i);
+            bool added = false;
+            for (int k = 0; k < clusters.size(); k++)
             {
-                bool added = false;
-                for (int k = 0; k < clusters.size(); k++)
-                {
-                    if (clusters.at(k).getClosestDistance(vec) < distance_threshold && 
-                        clusters.at(k).getClosestOrientation(vec) < angular_threshold)
-                    {
-                        clusters.at(k).addVector(vec);
-                        added = true;
-                    }
-                }
-                if (!added)
+                if (clusters.at(k).getClosestDistance(vec) < distance_threshold && 
+                    clusters.at(k).getClosestOrientation(vec) < angular_threshold)
                 {
-                    VectorCluster vc;
-                    vc.addVector(vec);
-                    clusters.push_back(vc);
+                    clusters.at(k).addVector(vec);
+                    added = true;
                 }
             }
+            if (!added)
+            {
+                VectorCluster vc;
+                vc.addVector(vec);
+                clusters.push_back(vc);
+            }
         }
     }
     std::vector<cv::Point2f> centroids;
@@ -114,156 +214,261 @@ std::vector<cv::Point2f> FlowClusterer::getClustersCenters(const cv::Mat &flow_v
     return centroids;
 }
 
-std::vector<std::vector<cv::Vec4d> > FlowClusterer::getClusters(const cv::Mat &flow_vectors, int pixel_step, double distance_threshold, double angular_threshold)
+std::vector<std::vector<cv::Vec4d> > FlowClusterer::getClusters(const FlowField &flow_vectors, double distance_threshold, double angular_threshold, int min_cluster_size)
 {
-#ifdef NEW_THING 
-    std::vector<VectorCluster> clusters;
-    for (int i = 0; i < flow_vectors.rows; i = i + pixel_step) 
+    int rows = flow_vectors.rows();
+    int cols = flow_vectors.cols();
+    const std::vector<float> &x = flow_vectors.getX();
+    const std::vector<float> &y = flow_vectors.getY();
+    const std::vector<float> &dx = flow_vectors.getDX();
+    const std::vector<float> &dy = flow_vectors.getDY();
+
+    // unit directions, so that comparing orientations is a dot product
+    std::vector<uchar> moving(flow_vectors.size(), 0);
+    std::vector<float> direction_x(flow_vectors.size());
+    std::vector<float> direction_y(flow_vectors.size());
+    for (int i = 0; i < flow_vectors.size(); i++)
     {
-        for (int j = 0; j < flow_vectors.cols; j = j + pixel_step)
+        if (dx[i] != 0.0f || dy[i] != 0.0f)
         {
-            cv::Vec4d vec = flow_vectors.at<cv::Vec4d>(i, j);
-            if (std::abs(vec[2]) > 0.0 || std::abs(vec[3]) > 0.0)
+            float norm = std::sqrt(dx[i] * dx[i] + dy[i] * dy[i]);
+            direction_x[i] = dx[i] / norm;
+            direction_y[i] = dy[i] / norm;
+            moving[i] = 1;
+        }
+    }
+    // the angle between two directions is below the threshold iff their dot
+    // product is above its cosine
+    double min_cosine = angular_threshold > M_PI ? -2.0 : std::cos(angular_threshold);
+    double max_squared_distance = distance_threshold * distance_threshold;
+    // start points are at most half a cell away from their grid point
+    int radius = std::max(cvCeil(distance_threshold / flow_vectors.getPixelStep()), 0);
+
+    // two vectors are connected if they are close and point the same way;
+    // the clusters are the connected components of the grid
+    UnionFind sets;
+    sets.reset(flow_vectors.size());
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < cols; c++)
+        {
+            int i = flow_vectors.getIndex(r, c);
+            if (!moving[i])
+            {
+                continue;
+            }
+            // each pair is tested once, from the cell that comes first
+            for (int nr = r; nr <= std::min(r + radius, rows - 1); nr++)
             {
-                bool added = false;
-                int index = -1;
-                
-                // TODO: test this, find best weighting for distance and angle
-                double best_score = std::numeric_limits<double>::max();
-                double closest_distance = std::numeric_limits<double>::max();
-                double closest_angle = std::numeric_limits<double>::max();
-                for (int k = 0; k < clusters.size(); k++)
+                int first_col = (nr == r) ? c + 1 : std::max(c - radius, 0);
+                for (int nc = first_col; nc <= std::min(c + radius, cols - 1); nc++)
                 {
-                    double distance = clusters.at(k).getClosestDistance(vec);
-                    double angle = clusters.at(k).getClosestOrientation(vec);
-                    if ((distance + angle * 10.0) < best_score)
+                    int j = flow_vectors.getIndex(nr, nc);
+                    if (!moving[j])
                     {
-                        best_score = (distance + angle * 10.0);
-                        index = k;
+                        continue;
+                    }
+                    double x_diff = x[i] - x[j];
+                    double y_diff = y[i] - y[j];
+                    if (x_diff * x_diff + y_diff * y_diff < max_squared_distance &&
+                        direction_x[i] * direction_x[j] + direction_y[i] * direction_y[j] > min_cosine)
+                    {
+                        sets.unite(i, j);
                     }
-                }
-                if (index != -1 && closest_distance < distance_threshold && closest_angle < angular_threshold)
-                {
-                    clusters.at(index).addVector(vec);
-                }
-                else
-                {
-                    VectorCluster vc;
-                    vc.addVector(vec);
-                    clusters.push_back(vc);
                 }
             }
         }
     }
-    std::vector<std::vector<cv::Vec4d> > mat_clusters;    
-    //std::cout << "clusters_zero: " << std::endl;
-    for (int i = 0; i < clusters.size(); i++)
+
+    // clusters in the order of their first vector
+    std::vector<int> cluster_index(flow_vectors.size(), -1);
+    std::vector<std::vector<cv::Vec4d> > clusters;
+    for (int i = 0; i < flow_vectors.size(); i++)
     {
-//        cv::Mat cluster_points(clusters.at(i).getCluster(), true);
-        if (clusters.at(i).size() > 5)
+        if (moving[i])
         {
-            //mat_clusters.push_back(clusters.at(i).getMeanVector());
-            mat_clusters.push_back(clusters.at(i).getCluster());
+            int root = sets.find(i);
+            if (cluster_index[root] == -1)
+            {
+                cluster_index[root] = clusters.size();
+                clusters.push_back(std::vector<cv::Vec4d>());
+            }
+            clusters.at(cluster_index[root]).push_back(flow_vectors.getVector(i));
         }
     }
-    /*
-    std::cout << "clusters_first: " << std::endl;
-    for (int i = 0; i < mat_clusters.size(); i++)
+    std::vector<std::vector<cv::Vec4d> > mat_clusters;    
+    for (int i = 0; i < clusters.size(); i++)
     {
-        std::cout << mat_clusters.at(i) << std::endl;
+        if (clusters.at(i).size() >= min_cluster_size)
+        {
+            mat_clusters.push_back(clusters.at(i));
+        }
     }
-    */
-    return mat_clusters;
-#endif
-    int count = 0;
-    std::vector<VectorCluster> clusters;
-    for (int i = 0; i < flow_vectors.rows; i = i + pixel_step)
+    return mat_clusters; 
+}
+
+/**
+ * Key of a cell of the hash grid.
+ */
+long long getCellKey(int cell_x, int cell_y)
+{
+    return ((long long)cell_x << 32) | (unsigned int)cell_y;
+}
+
+std::vector<std::vector<cv::Point2f>> FlowClusterer::clusterEuclidean(const std::vector<cv::Point2f> &points, double distance_threshold, int min_cluster_size)
+{
+    UnionFind sets;
+    sets.reset(points.size());
+    if (distance_threshold > 0.0)
     {
-        for (int j = 0; j < flow_vectors.cols; j = j + pixel_step)
+        // with cells as wide as the threshold, connected points are at most
+        // one cell apart
+        std::vector<std::pair<long long, int> > cell_points(points.size());
+        for (int i = 0; i < points.size(); i++)
         {
-            cv::Vec4d vec = flow_vectors.at<cv::Vec4d>(i, j);
-            if (std::abs(vec[2]) > 0.0 || std::abs(vec[3]) > 0.0)
+            int cell_x = cvFloor(points.at(i).x / distance_threshold);
+            int cell_y = cvFloor(points.at(i).y / distance_threshold);
+            cell_points.at(i) = std::make_pair(getCellKey(cell_x, cell_y), i);
+        }
+        std::sort(cell_points.begin(), cell_points.end());
+        // first and one past the last entry of every occupied cell
+        std::unordered_map<long long, std::pair<int, int> > cells;
+        for (int i = 0; i < cell_points.size(); )
+        {
+            int end = i;
+            while (end < cell_points.size() && cell_points.at(end).first == cell_points.at(i).first)
             {
-                count++;
-                bool added = false;
-                for (int k = 0; k < clusters.size(); k++)
+                end++;
+            }
+            cells[cell_points.at(i).first] = std::make_pair(i, end);
+            i = end;
+        }
+
+        double max_squared_distance = distance_threshold * distance_threshold;
+        for (int i = 0; i < points.size(); i++)
+        {
+            const cv::Point2f &point = points.at(i);
+            int cell_x = cvFloor(point.x / distance_threshold);
+            int cell_y = cvFloor(point.y / distance_threshold);
+            for (int nx = cell_x - 1; nx <= cell_x + 1; nx++)
+            {
+                for (int ny = cell_y - 1; ny <= cell_y + 1; ny++)
                 {
-                    if (clusters.at(k).getClosestDistance(vec) < distance_threshold && 
-                        clusters.at(k).getClosestOrientation(vec) < angular_threshold)
+                    std::unordered_map<long long, std::pair<int, int> >::const_iterator cell = cells.find(getCellKey(nx, ny));
+                    if (cell == cells.end())
                     {
-                        clusters.at(k).addVector(vec);
-                        added = true;
-                        break;
+                        continue;
+                    }
+                    for (int k = cell->second.first; k < cell->second.second; k++)
+                    {
+                        // each pair once
+                        int j = cell_points.at(k).second;
+                        if (j <= i)
+                        {
+                            continue;
+                        }
+                        double x_diff = point.x - points.at(j).x;
+                        double y_diff = point.y - points.at(j).y;
+                        if (x_diff * x_diff + y_diff * y_diff < max_squared_distance)
+                        {
+                            sets.unite(i, j);
+                        }
                     }
-                }
-                if (!added)
-                {
-                    VectorCluster vc;
-                    vc.addVector(vec);
-                    clusters.push_back(vc);
                 }
             }
         }
     }
-    std::vector<std::vector<cv::Vec4d> > mat_clusters;    
-    //std::cout << "clusters_zero: " << std::endl;
-    for (int i = 0; i < clusters.size(); i++)
+
+    // clusters in the order of their first point
+    std::vector<int> cluster_index(points.size(), -1);
+    std::vector<std::vector<cv::Point2f> > clusters;
+    for (int i = 0; i < points.size(); i++)
     {
-//        cv::Mat cluster_points(clusters.at(i).getCluster(), true);
-        if (clusters.at(i).size() > 5)
+        int root = sets.find(i);
+        if (cluster_index[root] == -1)
         {
-            //mat_clusters.push_back(clusters.at(i).getMeanVector());
-            mat_clusters.push_back(clusters.at(i).getCluster());
+            cluster_index[root] = clusters.size();
+            clusters.push_back(std::vector<cv::Point2f>());
         }
+        clusters.at(cluster_index[root]).push_back(points.at(i));
     }
-    /*
-    std::cout << "clusters_first: " << std::endl;
-    for (int i = 0; i < mat_clusters.size(); i++)
+    std::vector<std::vector<cv::Point2f> > mat_clusters;    
+    for (int i = 0; i < clusters.size(); i++)
     {
-        std::cout << mat_clusters.at(i) << std::endl;
+        if (clusters.at(i).size() >= min_cluster_size)
+        {
+            mat_clusters.push_back(clusters.at(i));
+        }
     }
-    */
-    std::cout << "num vectors: " << count << std::endl;
-    return mat_clusters; 
-
+    return mat_clusters;
 }
 
-std::vector<std::vector<cv::Point2f>> FlowClusterer::clusterEuclidean(const std::vector<cv::Point2f> &points, double distance_threshold)
+std::vector<std::vector<cv::Vec4d> > FlowClusterer::clusterDensity(const FlowField &flow_vectors, double distance_threshold, double angular_threshold, int min_points, int min_cluster_size)
 {
-    std::vector<PointCluster> clusters;
-    for (int i = 0; i < points.size(); i++)
+    samples_.clear();
+    sample_cells_.clear();
+    directions_.clear();
+    const std::vector<float> &x = flow_vectors.getX();
+    const std::vector<float> &y = flow_vectors.getY();
+    const std::vector<float> &dx = flow_vectors.getDX();
+    const std::vector<float> &dy = flow_vectors.getDY();
+    for (int i = 0; i < flow_vectors.size(); i++)
     {
-        cv::Point2f point = points.at(i);
-        bool added = false;
-        double closest_distance = std::numeric_limits<double>::max(); 
-        int index = -1;
-        for (int k = 0; k < clusters.size(); k++)
+        if (flow_vectors.isMoving(i))
         {
-            double distance = clusters.at(k).getClosestDistance(point);
-            if (distance < closest_distance)
-            {
-                closest_distance = distance;
-                index = k;
-            }
+            float norm = std::sqrt(dx[i] * dx[i] + dy[i] * dy[i]);
+            samples_.push_back(cv::Point2f(x[i], y[i]));
+            directions_.push_back(cv::Point2f(dx[i] / norm, dy[i] / norm));
+            sample_cells_.push_back(i);
         }
-        if (index != -1 && closest_distance < distance_threshold)
+    }
+    double min_cosine = angular_threshold > M_PI ? -2.0 : std::cos(angular_threshold);
+    int num_clusters = density_clusterer_.cluster(samples_, directions_, distance_threshold, min_cosine, min_points, labels_);
+
+    std::vector<std::vector<cv::Vec4d> > clusters(num_clusters);
+    for (int s = 0; s < samples_.size(); s++)
+    {
+        if (labels_.at(s) != -1)
         {
-            clusters.at(index).addPoint(point);
+            clusters.at(labels_.at(s)).push_back(flow_vectors.getVector(sample_cells_.at(s)));
         }
-        else
+    }
+    std::vector<std::vector<cv::Vec4d> > mat_clusters;
+    for (int i = 0; i < clusters.size(); i++)
+    {
+        if (clusters.at(i).size() >= min_cluster_size)
         {
-            PointCluster pc;
-            pc.addPoint(point);
-            clusters.push_back(pc);
+            mat_clusters.push_back(clusters.at(i));
         }
     }
-    std::vector<std::vector<cv::Point2f> > mat_clusters;    
+    return mat_clusters;
+}
+
+std::vector<std::vector<cv::Point2f> > FlowClusterer::clusterDensity(const std::vector<cv::Point2f> &points, double distance_threshold, int min_points, int min_cluster_size)
+{
+    directions_.clear();
+    int num_clusters = density_clusterer_.cluster(points, directions_, distance_threshold, -2.0, min_points, labels_);
+
+    std::vector<std::vector<cv::Point2f> > clusters(num_clusters);
+    for (int i = 0; i < points.size(); i++)
+    {
+        if (labels_.at(i) != -1)
+        {
+            clusters.at(labels_.at(i)).push_back(points.at(i));
+        }
+    }
+    std::vector<std::vector<cv::Point2f> > mat_clusters;
     for (int i = 0; i < clusters.size(); i++)
     {
-        if (clusters.at(i).size() > 5)
+        if (clusters.at(i).size() >= min_cluster_size)
         {
-            mat_clusters.push_back(clusters.at(i).getCluster());
+            mat_clusters.push_back(clusters.at(i));
         }
     }
     return mat_clusters;
 }
+
+void FlowClusterer::setNumThreads(int num_threads)
+{
+    density_clusterer_.setNumThreads(num_threads);
+}
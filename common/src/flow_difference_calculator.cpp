@@ -17,17 +17,19 @@ FlowDifferenceCalculator::~FlowDifferenceCalculator()
 {
 }
 
-void FlowDifferenceCalculator::calculateFlowDifference(const cv::Mat &first, const cv::Mat &second, cv::Mat &diff, int pixel_step)
+void FlowDifferenceCalculator::calculateFlowDifference(const FlowField &first, const FlowField &second, FlowField &diff)
 {
-    for (int i = 0; i < first.rows; i = i + pixel_step)
+    diff.reset(first.getImageSize(), first.getPixelStep());
+    const std::vector<float> &first_dx = first.getDX();
+    const std::vector<float> &first_dy = first.getDY();
+    const std::vector<float> &second_dx = second.getDX();
+    const std::vector<float> &second_dy = second.getDY();
+    for (int i = 0; i < first.size(); i++)
     {
-        for (int j = 0; j < first.cols; j = j + pixel_step)
+        if (first.isValid(i))
         {
-            cv::Vec4d &elem = diff.at<cv::Vec4d>(i,j);
-            elem[0] = first.at<cv::Vec4d>(i,j)[0];
-            elem[1] = first.at<cv::Vec4d>(i,j)[1];
-            elem[2] = first.at<cv::Vec4d>(i,j)[2] - second.at<cv::Vec4d>(i,j)[2];
-            elem[3] = first.at<cv::Vec4d>(i,j)[3] - second.at<cv::Vec4d>(i,j)[3];
+            cv::Point2f start(first.getX()[i], first.getY()[i]);
+            diff.setVector(i, start, cv::Point2f(first_dx[i] - second_dx[i], first_dy[i] - second_dy[i]));
         }
     }    
 }
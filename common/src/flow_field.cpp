@@ -0,0 +1,145 @@
+/* flow_field.cpp
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include <motion_detection/flow_field.h>
+#include <algorithm>
+
+FlowField::FlowField() : pixel_step_(1), rows_(0), cols_(0)
+{
+}
+
+FlowField::~FlowField()
+{
+}
+
+void FlowField::reset(const cv::Size &image_size, int pixel_step)
+{
+    image_size_ = image_size;
+    pixel_step_ = std::max(pixel_step, 1);
+    // same grid points as the loops over the image with step pixel_step
+    rows_ = (image_size.height + pixel_step_ - 1) / pixel_step_;
+    cols_ = (image_size.width + pixel_step_ - 1) / pixel_step_;
+    x_.assign(rows_ * cols_, 0.0f);
+    y_.assign(rows_ * cols_, 0.0f);
+    dx_.assign(rows_ * cols_, 0.0f);
+    dy_.assign(rows_ * cols_, 0.0f);
+    valid_.assign(rows_ * cols_, 0);
+}
+
+int FlowField::rows() const
+{
+    return rows_;
+}
+
+int FlowField::cols() const
+{
+    return cols_;
+}
+
+int FlowField::size() const
+{
+    return rows_ * cols_;
+}
+
+bool FlowField::empty() const
+{
+    return rows_ * cols_ == 0;
+}
+
+int FlowField::getPixelStep() const
+{
+    return pixel_step_;
+}
+
+cv::Size FlowField::getImageSize() const
+{
+    return image_size_;
+}
+
+int FlowField::getIndex(int row, int col) const
+{
+    return row * cols_ + col;
+}
+
+int FlowField::getIndex(const cv::Point2f &pixel) const
+{
+    int row = cvRound(pixel.y / pixel_step_);
+    int col = cvRound(pixel.x / pixel_step_);
+    if (row < 0 || col < 0 || row >= rows_ || col >= cols_)
+    {
+        return -1;
+    }
+    return getIndex(row, col);
+}
+
+cv::Point FlowField::getPixel(int index) const
+{
+    return cv::Point((index % cols_) * pixel_step_, (index / cols_) * pixel_step_);
+}
+
+void FlowField::setVector(int index, const cv::Point2f &start, const cv::Point2f &displacement)
+{
+    x_.at(index) = start.x;
+    y_.at(index) = start.y;
+    dx_.at(index) = displacement.x;
+    dy_.at(index) = displacement.y;
+    valid_.at(index) = 1;
+}
+
+void FlowField::setLost(int index)
+{
+    x_.at(index) = -1.0f;
+    y_.at(index) = -1.0f;
+    dx_.at(index) = 0.0f;
+    dy_.at(index) = 0.0f;
+    valid_.at(index) = 0;
+}
+
+bool FlowField::isValid(int index) const
+{
+    return valid_.at(index) != 0;
+}
+
+bool FlowField::isMoving(int index) const
+{
+    return dx_.at(index) != 0.0f || dy_.at(index) != 0.0f;
+}
+
+cv::Vec4d FlowField::getVector(int index) const
+{
+    if (!valid_.at(index))
+    {
+        return cv::Vec4d(-1.0, -1.0, 0.0, 0.0);
+    }
+    return cv::Vec4d(x_.at(index), y_.at(index), dx_.at(index), dy_.at(index));
+}
+
+const std::vector<float> &FlowField::getX() const
+{
+    return x_;
+}
+
+const std::vector<float> &FlowField::getY() const
+{
+    return y_;
+}
+
+const std::vector<float> &FlowField::getDX() const
+{
+    return dx_;
+}
+
+const std::vector<float> &FlowField::getDY() const
+{
+    return dy_;
+}
+
+const std::vector<uchar> &FlowField::getValid() const
+{
+    return valid_;
+}
@@ -17,57 +17,51 @@ FlowNeighbourSimilarityCalculator::~FlowNeighbourSimilarityCalculator()
 {
 }
 
-void FlowNeighbourSimilarityCalculator::calculateNeighbourhoodSimilarity(const cv::Mat &vectors, cv::Mat &similarity, int pixel_step)
+void FlowNeighbourSimilarityCalculator::calculateNeighbourhoodSimilarity(const FlowField &vectors, cv::Mat &similarity)
 {
-    for (int i = 0; i < vectors.rows; i = i + pixel_step)
+    similarity = cv::Mat::zeros(vectors.rows(), vectors.cols(), CV_64F);
+    for (int i = 0; i < vectors.rows(); i++)
     {
-        for (int j = 0; j < vectors.cols; j = j + pixel_step)
+        for (int j = 0; j < vectors.cols(); j++)
         {           
-            if (j != 0)
-            {
-            //    std::cout << ", ";
-            }
-            cv::Vec4d vec = vectors.at<cv::Vec4d>(i, j);
+            cv::Vec4d vec = vectors.getVector(vectors.getIndex(i, j));
             if (abs(vec[2]) < 1.0 && abs(vec[3]) < 1.0)
             {
-            //    std::cout << "0.0";
                 continue;
             }
-            double sim = similarity.at<double>(i,j);
             double similarityMeasure = 0.0;
             int num_neighbours = 0;
             if (i != 0)
             {
-                cv::Vec4d top_neighbour = vectors.at<cv::Vec4d>(i - pixel_step, j);
+                cv::Vec4d top_neighbour = vectors.getVector(vectors.getIndex(i - 1, j));
                 similarityMeasure += getSimilarityMeasure(vec, top_neighbour);
                 num_neighbours++;                
             }
             if (j != 0)
             {
-                cv::Vec4d left_neighbour = vectors.at<cv::Vec4d>(i, j - pixel_step);
+                cv::Vec4d left_neighbour = vectors.getVector(vectors.getIndex(i, j - 1));
                 similarityMeasure += getSimilarityMeasure(vec, left_neighbour);
                 num_neighbours++;
             }
-            if (i < vectors.rows - pixel_step)
+            if (i < vectors.rows() - 1)
             {
-                cv::Vec4d bottom_neighbour = vectors.at<cv::Vec4d>(i + pixel_step, j);
+                cv::Vec4d bottom_neighbour = vectors.getVector(vectors.getIndex(i + 1, j));
                 similarityMeasure += getSimilarityMeasure(vec, bottom_neighbour);
                 num_neighbours++;                
             }
-            if (j < vectors.cols - pixel_step)
+            if (j < vectors.cols() - 1)
             {
-                cv::Vec4d right_neighbour = vectors.at<cv::Vec4d>(i, j + pixel_step);
+                cv::Vec4d right_neighbour = vectors.getVector(vectors.getIndex(i, j + 1));
                 similarityMeasure += getSimilarityMeasure(vec, right_neighbour);
                 num_neighbours++;
             }
 
-            similarityMeasure /= num_neighbours;
-            sim = similarityMeasure;
-           // std::cout << sim;           
+            if (num_neighbours > 0)
+            {
+                similarity.at<double>(i, j) = similarityMeasure / num_neighbours;
+            }
         }
-       // std::cout << std::endl;
     }
-  //  std::cout << std::endl << std::endl << std::endl << std::endl;
 }
 
 double FlowNeighbourSimilarityCalculator::getSimilarityMeasure(const cv::Vec4d &one, const cv::Vec4d &two)
@@ -0,0 +1,135 @@
+/* frame_cache.cpp
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include <motion_detection/frame_cache.h>
+#include <opencv2/video/tracking.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+FrameCache::FrameCache() : capacity_(2), start_(0), size_(0)
+{
+    frames_.resize(capacity_);
+}
+
+FrameCache::~FrameCache()
+{
+}
+
+void FrameCache::setCapacity(int capacity)
+{
+    capacity = std::max(capacity, 2);
+    if (capacity != capacity_)
+    {
+        capacity_ = capacity;
+        frames_.clear();
+        frames_.resize(capacity_);
+        start_ = 0;
+        size_ = 0;
+    }
+}
+
+void FrameCache::clear()
+{
+    start_ = 0;
+    size_ = 0;
+}
+
+const CachedFrame &FrameCache::addFrame(const cv::Mat &image)
+{
+    // cvtColor and buildOpticalFlowPyramid reuse the buffers of the slot
+    // as long as the image size does not change
+    CachedFrame &frame = nextSlot();
+    if (frame.gray_image.data == frame.image.data)
+    {
+        // the slot held a grayscale frame owned by the caller, do not write into it
+        frame.gray_image.release();
+    }
+    frame.image = image;
+    if (image.channels() == 3)
+    {
+        cv::cvtColor(image, frame.gray_image, CV_BGR2GRAY);
+    }
+    else
+    {
+        frame.gray_image = image;
+    }
+    cv::buildOpticalFlowPyramid(frame.gray_image, frame.pyramid, windowSize(), maxLevel(), true);
+    return frame;
+}
+
+const CachedFrame &FrameCache::addFrame(const cv::Mat &image, ImagePreprocessor::PixelFormat format, int scale, bool keep_colour)
+{
+    CachedFrame &frame = nextSlot();
+    if (frame.gray_image.data == frame.image.data)
+    {
+        frame.gray_image.release();
+    }
+    ImagePreprocessor::toGray(image, format, scale, frame.gray_image);
+    if (keep_colour)
+    {
+        ImagePreprocessor::toRGB(image, format, scale, frame.image);
+    }
+    else
+    {
+        frame.image.release();
+    }
+    cv::buildOpticalFlowPyramid(frame.gray_image, frame.pyramid, windowSize(), maxLevel(), true);
+    return frame;
+}
+
+const CachedFrame &FrameCache::at(int index) const
+{
+    return frames_.at((start_ + index) % capacity_);
+}
+
+const CachedFrame &FrameCache::back() const
+{
+    return at(size_ - 1);
+}
+
+int FrameCache::size() const
+{
+    return size_;
+}
+
+bool FrameCache::isFull() const
+{
+    return size_ == capacity_;
+}
+
+void FrameCache::getPyramids(std::vector<std::vector<cv::Mat> > &pyramids) const
+{
+    pyramids.clear();
+    for (int i = 0; i < size_; i++)
+    {
+        pyramids.push_back(at(i).pyramid);
+    }
+}
+
+CachedFrame &FrameCache::nextSlot()
+{
+    int index = (start_ + size_) % capacity_;
+    if (size_ == capacity_)
+    {
+        start_ = (start_ + 1) % capacity_;
+    }
+    else
+    {
+        size_++;
+    }
+    return frames_.at(index);
+}
+
+cv::Size FrameCache::windowSize()
+{
+    return cv::Size(40, 40);
+}
+
+int FrameCache::maxLevel()
+{
+    return 5;
+}
@@ -0,0 +1,128 @@
+/* image_preprocessor.cpp
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include <motion_detection/image_preprocessor.h>
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace
+{
+    // ITU-R BT.601 luma weights in 14 bit fixed point, as used by cvtColor
+    const int R_WEIGHT = 4899;
+    const int G_WEIGHT = 9617;
+    const int B_WEIGHT = 1868;
+    const int SHIFT = 14;
+
+    void colourToGray(const cv::Mat &image, int r_offset, int b_offset, int scale, cv::Mat &gray)
+    {
+        for (int i = 0; i < gray.rows; i++)
+        {
+            uchar *out = gray.ptr<uchar>(i);
+            if (scale == 1)
+            {
+                const uchar *in = image.ptr<uchar>(i);
+                for (int j = 0; j < gray.cols; j++)
+                {
+                    const uchar *p = in + 3 * j;
+                    out[j] = (uchar)((p[r_offset] * R_WEIGHT + p[1] * G_WEIGHT + p[b_offset] * B_WEIGHT + (1 << (SHIFT - 1))) >> SHIFT);
+                }
+            }
+            else
+            {
+                // average of the 2x2 block folded into the weighted sum
+                const uchar *in1 = image.ptr<uchar>(2 * i);
+                const uchar *in2 = image.ptr<uchar>(2 * i + 1);
+                for (int j = 0; j < gray.cols; j++)
+                {
+                    const uchar *p1 = in1 + 6 * j;
+                    const uchar *p2 = in2 + 6 * j;
+                    int r = p1[r_offset] + p1[r_offset + 3] + p2[r_offset] + p2[r_offset + 3];
+                    int g = p1[1] + p1[4] + p2[1] + p2[4];
+                    int b = p1[b_offset] + p1[b_offset + 3] + p2[b_offset] + p2[b_offset + 3];
+                    out[j] = (uchar)((r * R_WEIGHT + g * G_WEIGHT + b * B_WEIGHT + (1 << (SHIFT + 1))) >> (SHIFT + 2));
+                }
+            }
+        }
+    }
+
+    // picks one byte out of every pixel_size bytes (mono8 and the Y channel of packed YUV)
+    void channelToGray(const cv::Mat &image, int pixel_size, int offset, int scale, cv::Mat &gray)
+    {
+        for (int i = 0; i < gray.rows; i++)
+        {
+            uchar *out = gray.ptr<uchar>(i);
+            if (scale == 1)
+            {
+                const uchar *in = image.ptr<uchar>(i) + offset;
+                for (int j = 0; j < gray.cols; j++)
+                {
+                    out[j] = in[pixel_size * j];
+                }
+            }
+            else
+            {
+                const uchar *in1 = image.ptr<uchar>(2 * i) + offset;
+                const uchar *in2 = image.ptr<uchar>(2 * i + 1) + offset;
+                for (int j = 0; j < gray.cols; j++)
+                {
+                    int k = 2 * pixel_size * j;
+                    out[j] = (uchar)((in1[k] + in1[k + pixel_size] + in2[k] + in2[k + pixel_size] + 2) >> 2);
+                }
+            }
+        }
+    }
+}
+
+ImagePreprocessor::ImagePreprocessor()
+{
+}
+
+ImagePreprocessor::~ImagePreprocessor()
+{
+}
+
+void ImagePreprocessor::toGray(const cv::Mat &image, PixelFormat format, int scale, cv::Mat &gray)
+{
+    CV_Assert(scale == 1 || scale == 2);
+    gray.create(image.rows / scale, image.cols / scale, CV_8UC1);
+    switch (format)
+    {
+        case MONO8: channelToGray(image, 1, 0, scale, gray); break;
+        case BGR8: colourToGray(image, 2, 0, scale, gray); break;
+        // rgb8 used to be converted with CV_BGR2GRAY, which swapped the red
+        // and blue weights; its gray values, and so its tracks, differ from then
+        case RGB8: colourToGray(image, 0, 2, scale, gray); break;
+        case YUYV: channelToGray(image, 2, 0, scale, gray); break;
+        case UYVY: channelToGray(image, 2, 1, scale, gray); break;
+    }
+}
+
+void ImagePreprocessor::toRGB(const cv::Mat &image, PixelFormat format, int scale, cv::Mat &rgb)
+{
+    cv::Mat converted;
+    switch (format)
+    {
+        case MONO8: cv::cvtColor(image, converted, CV_GRAY2RGB); break;
+        case BGR8: cv::cvtColor(image, converted, CV_BGR2RGB); break;
+        case RGB8: converted = image; break;
+        case YUYV: cv::cvtColor(image, converted, CV_YUV2RGB_YUYV); break;
+        case UYVY: cv::cvtColor(image, converted, CV_YUV2RGB_UYVY); break;
+    }
+    if (scale > 1)
+    {
+        cv::resize(converted, rgb, cv::Size(), 1.0 / scale, 1.0 / scale, CV_INTER_AREA);
+    }
+    else if (converted.data == image.data)
+    {
+        // image may point into a shared message buffer, so keep a copy
+        image.copyTo(rgb);
+    }
+    else
+    {
+        rgb = converted;
+    }
+}
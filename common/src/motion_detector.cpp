@@ -0,0 +1,102 @@
+/* motion_detector.cpp
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include <motion_detection/motion_detector.h>
+
+MotionDetector::MotionDetector(bool egomotion) : egomotion_(egomotion)
+{
+}
+
+MotionDetector::~MotionDetector()
+{
+}
+
+void MotionDetector::reset()
+{
+    tracker_.reset();
+    od_.reset();
+}
+
+bool MotionDetector::track(const PipelineConfig &config, const CachedFrame &frame, MotionDetectionResult &result)
+{
+    tracker_.setParameters(config.getTrajectorySize(egomotion_), config.pixel_step, config.min_vector_size);
+    tracker_.setSeeding(config.seed_border, config.merge_tracks);
+
+    tracker_.addFrame(frame.pyramid, result.optical_flow_vectors);
+    if (!tracker_.isWindowFull())
+    {
+        return false;
+    }
+    tracker_.getTracks(result.tracks);
+    return true;
+}
+
+void MotionDetector::detect(const PipelineConfig &config, MotionDetectionResult &result)
+{
+    result.trajectory_subspace_vectors.clear();
+    result.clusters.clear();
+    result.bounding_boxes.clear();
+    if (result.tracks.size() == 0)
+    {
+        return;
+    }
+
+    if (egomotion_)
+    {
+        std::vector<cv::Point2f> outlier_points;
+        od_.setRansacParameters(config.ransac_seed, config.ransac_threads, config.ransac_confidence, config.ransac_max_iterations);
+        od_.setWarmStart(config.subspace_warm_start, config.warm_start_min_inlier_ratio);
+        od_.setMaxTrajectories(config.subspace_max_trajectories);
+        result.trajectory_subspace_vectors = od_.fitSubspace(result.tracks, outlier_points, config.num_motions, config.sigma);
+        if (config.clustering_method == "density")
+        {
+            fc_.setNumThreads(config.clustering_threads);
+            result.clusters = fc_.clusterDensity(outlier_points, config.distance_threshold, config.density_min_points, config.min_cluster_size);
+        }
+        else
+        {
+            result.clusters = fc_.clusterEuclidean(outlier_points, config.distance_threshold, config.min_cluster_size);
+        }
+    }
+    else
+    {
+        std::vector<std::vector<cv::Vec4d> > cluster_vec;
+        if (config.clustering_method == "density")
+        {
+            fc_.setNumThreads(config.clustering_threads);
+            cluster_vec = fc_.clusterDensity(result.optical_flow_vectors, config.distance_threshold, config.angular_threshold, config.density_min_points, config.min_cluster_size);
+        }
+        else
+        {
+            cluster_vec = fc_.getClusters(result.optical_flow_vectors, config.distance_threshold, config.angular_threshold, config.min_cluster_size);
+        }
+        for (int i = 0; i < cluster_vec.size(); i++)
+        {
+            std::vector<cv::Point2f> cc;
+            const std::vector<cv::Vec4d> &cc_v = cluster_vec.at(i);
+            for (int j = 0; j < cc_v.size(); j++)
+            {
+                cc.push_back(cv::Point2f(cc_v.at(j)[0], cc_v.at(j)[1]));
+            }
+            result.clusters.push_back(cc);
+        }
+    }
+    result.bounding_boxes = ofv_.getBoundingBoxes(result.clusters);
+}
+
+void MotionDetector::setEgomotion(bool egomotion)
+{
+    egomotion_ = egomotion;
+    tracker_.reset();
+    od_.reset();
+}
+
+bool MotionDetector::isEgomotion() const
+{
+    return egomotion_;
+}
@@ -7,6 +7,7 @@
  */
 
 #include <motion_detection/optical_flow_calculator.h>
+#include <motion_detection/track_store.h>
 #include <iostream>
 #include <opencv2/video/tracking.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -15,6 +16,7 @@
 #include <opencv/highgui.h>
 #include <motion_detection/VarFlow.h>
 #include <motion_detection/slic.h>
+#include <motion_detection/frame_cache.h>
 #include <fstream>
 
 OpticalFlowCalculator::OpticalFlowCalculator()
@@ -27,7 +29,17 @@ OpticalFlowCalculator::~OpticalFlowCalculator()
 
 }
 
-int OpticalFlowCalculator::calculateOpticalFlow(const cv::Mat &image1, const cv::Mat &image2, cv::Mat &optical_flow_vectors, int pixel_step, cv::Mat &comp, double min_vector_size)
+int OpticalFlowCalculator::calculateOpticalFlow(const cv::Mat &image1, const cv::Mat &image2, FlowField &optical_flow_vectors, int pixel_step, double min_vector_size)
+{
+    return calculateOpticalFlow(image1, image2, optical_flow_vectors, pixel_step, NULL, min_vector_size);
+}
+
+int OpticalFlowCalculator::calculateOpticalFlow(const cv::Mat &image1, const cv::Mat &image2, FlowField &optical_flow_vectors, int pixel_step, cv::Mat &comp, double min_vector_size)
+{
+    return calculateOpticalFlow(image1, image2, optical_flow_vectors, pixel_step, &comp, min_vector_size);
+}
+
+int OpticalFlowCalculator::calculateOpticalFlow(const cv::Mat &image1, const cv::Mat &image2, FlowField &optical_flow_vectors, int pixel_step, cv::Mat *comp, double min_vector_size)
 {
     /*
     const int MAX_LEVEL = 2;
@@ -50,6 +62,8 @@ int OpticalFlowCalculator::calculateOpticalFlow(const cv::Mat &image1, const cv:
     cvtColor(image1, gray_image1, CV_BGR2GRAY);
     cvtColor(image2, gray_image2, CV_BGR2GRAY);
 
+    optical_flow_vectors.reset(image1.size(), pixel_step);
+
     std::vector<cv::Point2f> points_image1;
     std::vector<cv::Point2f> points_image2;
 
@@ -85,173 +99,128 @@ int OpticalFlowCalculator::calculateOpticalFlow(const cv::Mat &image1, const cv:
             float y_diff = end_point.y - start_point.y;
             if (std::abs(x_diff) > min_vector_size || std::abs(y_diff) > min_vector_size) // THIS USED TO BE 1.0
             {
-                cv::Vec4d &elem = optical_flow_vectors.at<cv::Vec4d> ((int)start_point.y, (int)start_point.x);
-                elem[0] = start_point.x;
-                elem[1] = start_point.y;
-                elem[2] = x_diff;
-                elem[3] = y_diff;
-                //elem[2] = atan2(y_diff, x_diff);
-                //elem[3] = sqrt(x_diff*x_diff + y_diff*y_diff);
-                src_points.push_back(start_point);
-                dst_points.push_back(end_point);
+                optical_flow_vectors.setVector(optical_flow_vectors.getIndex(start_point), start_point, cv::Point2f(x_diff, y_diff));
+                if (comp != NULL)
+                {
+                    src_points.push_back(start_point);
+                    dst_points.push_back(end_point);
+                }
                 num_vectors++;
             }
             else
             {
-                cv::Vec4d &elem = optical_flow_vectors.at<cv::Vec4d> ((int)start_point.y, (int)start_point.x);
-                elem[0] = start_point.x;
-                elem[1] = start_point.y;
-                elem[2] = 0.0;
-                elem[3] = 0.0;
+                optical_flow_vectors.setVector(optical_flow_vectors.getIndex(start_point), start_point, cv::Point2f(0.0f, 0.0f));
             }
         }
         else
         {
             cv::Point2f start_point = points_image1.at(i);
-            cv::Vec4d &elem = optical_flow_vectors.at<cv::Vec4d> ((int)start_point.y, (int)start_point.x);
-            elem[0] = -1.0;
-            elem[1] = -1.0;
-            elem[2] = 0.0;
-            elem[3] = 0.0;
+            optical_flow_vectors.setLost(optical_flow_vectors.getIndex(start_point));
         }
     }
-    if (num_vectors > 0)
+    // the compensated difference image is only built when the caller asks for it
+    if (num_vectors > 0 && comp != NULL)
     {
         cv::Mat pers_transform = cv::getPerspectiveTransform(&src_points[0], &dst_points[0]);
         cv::Mat compensated;
         gray_image2.copyTo(compensated);
-        gray_image2.copyTo(comp);
+        gray_image2.copyTo(*comp);
         cv::warpPerspective(gray_image1, compensated, pers_transform, cv::Size(gray_image1.cols, gray_image1.rows));
-        cv::absdiff(compensated, gray_image2, comp);
+        cv::absdiff(compensated, gray_image2, *comp);
         //std::cout << comp << std::endl;
-        cv::threshold(comp, comp, 190, 255, CV_THRESH_BINARY);
+        cv::threshold(*comp, *comp, 190, 255, CV_THRESH_BINARY);
     }
     return num_vectors;
 }
 
 
-int OpticalFlowCalculator::calculateOpticalFlowTrajectory(const std::vector<cv::Mat> &images, cv::Mat &optical_flow_vectors, 
+int OpticalFlowCalculator::calculateOpticalFlowTrajectory(const std::vector<cv::Mat> &images, FlowField &optical_flow_vectors, 
                                         std::vector<std::vector<cv::Point2f> > &trajectories, int pixel_step, cv::Mat &comp, double min_vector_size)
 {
-    
-    const int MAX_LEVEL = 5;
-    cv::Size winSize(40, 40);
+    // convert and build the pyramid of every frame once, not once per pair
+    std::vector<std::vector<cv::Mat> > pyramids(images.size());
+    for (int j = 0; j < images.size(); j++)
+    {
+        cv::Mat gray_image;
+        cvtColor(images.at(j), gray_image, CV_BGR2GRAY);
+        cv::buildOpticalFlowPyramid(gray_image, pyramids.at(j), FrameCache::windowSize(), FrameCache::maxLevel(), true);
+    }
+    return calculateOpticalFlowTrajectory(pyramids, optical_flow_vectors, trajectories, pixel_step, min_vector_size);
+}
+
+int OpticalFlowCalculator::calculateOpticalFlowTrajectory(const std::vector<std::vector<cv::Mat> > &pyramids, FlowField &optical_flow_vectors, 
+                                        std::vector<std::vector<cv::Point2f> > &trajectories, int pixel_step, double min_vector_size)
+{
+    const int MAX_LEVEL = FrameCache::maxLevel();
+    cv::Size winSize = FrameCache::windowSize();
     std::vector<uchar> status;
     std::vector<float> err;
     cv::TermCriteria termcrit(CV_TERMCRIT_ITER | CV_TERMCRIT_EPS, 10, 0.03);
 
-    std::vector<std::vector<cv::Point2f> > init_traj_list; 
+    cv::Size image_size = pyramids[0][0].size();
+    optical_flow_vectors.reset(image_size, pixel_step);
+
+    // a track is complete only if every step succeeded, so tracks that were
+    // lost once stay shorter than the window
+    TrackStore tracks;
+    tracks.reset(pyramids.size());
 
     // initialize points we want to track
     std::vector<cv::Point2f> points_image1;
     std::vector<cv::Point2f> points_image2;
-    for (int i = 0; i < images[0].cols; i = i + pixel_step)
+    for (int i = 0; i < image_size.width; i = i + pixel_step)
     {
-        for (int j = 0; j < images[0].rows; j = j + pixel_step)
+        for (int j = 0; j < image_size.height; j = j + pixel_step)
         {
             cv::Point2f point(i, j);
             points_image1.push_back(point);
-            std::vector<cv::Point2f> traj;
-            traj.push_back(point);
-            init_traj_list.push_back(traj);
+            tracks.addTrack(point);
         }
     }
 
     int num_vectors = 0;
-    for (int j = 0; j < images.size() - 1; j++)
+    for (int j = 0; j < pyramids.size() - 1; j++)
     {
-        cv::Mat gray_image1;
-        cv::Mat gray_image2;
-
-        cvtColor(images.at(j), gray_image1, CV_BGR2GRAY);
-        cvtColor(images.at(j+1), gray_image2, CV_BGR2GRAY);
-
-        std::vector<cv::Mat> pyramids;
-        cv::buildOpticalFlowPyramid(gray_image1, pyramids, winSize, MAX_LEVEL, true);
-
-        cv::calcOpticalFlowPyrLK(pyramids, gray_image2, points_image1, points_image2, status, err, winSize, MAX_LEVEL, termcrit, 0, 0.001);
-
+        cv::calcOpticalFlowPyrLK(pyramids.at(j), pyramids.at(j+1), points_image1, points_image2, status, err, winSize, MAX_LEVEL, termcrit, 0, 0.001);
 
-        std::vector<cv::Point2f> temp;
-        
-        int found_vectors = 0;
+        // points that are lost or leave the image stay where they were
         for (int i = 0; i < points_image2.size(); i++)
         {
+            cv::Point2f start_point = points_image1.at(i);
+            // moved points are stored in the cell of the closest grid point
+            int index = optical_flow_vectors.getIndex(start_point);
             if (status[i])
             {
-                found_vectors++;
-                if (j == images.size() - 2)
+                if (j == pyramids.size() - 2 && index != -1)
                 {
-                    cv::Point2f start_point = points_image1.at(i);
                     cv::Point2f end_point = points_image2.at(i);
                     float x_diff = end_point.x - start_point.x;
                     float y_diff = end_point.y - start_point.y;
                     if (std::abs(x_diff) > min_vector_size || std::abs(y_diff) > min_vector_size) // THIS USED TO BE 1.0
                     {
-                        cv::Vec4d &elem = optical_flow_vectors.at<cv::Vec4d> ((int)start_point.y, (int)start_point.x);
-                        elem[0] = start_point.x;
-                        elem[1] = start_point.y;
-                        elem[2] = x_diff;
-                        elem[3] = y_diff;
                         num_vectors++;
                     }
                     else
                     {
-                        cv::Vec4d &elem = optical_flow_vectors.at<cv::Vec4d> ((int)start_point.y, (int)start_point.x);
-                        elem[0] = start_point.x;
-                        elem[1] = start_point.y;
-                        elem[2] = 0.0;
-                        elem[3] = 0.0;
+                        x_diff = 0.0f;
+                        y_diff = 0.0f;
                     }
+                    optical_flow_vectors.setVector(index, start_point, cv::Point2f(x_diff, y_diff));
                 }
                 if (points_image2.at(i).x > 10.0 && points_image2.at(i).y > 10.0
-                    && points_image2.at(i).x < images[0].cols-10 && points_image2.at(i).y < images[0].rows-10)
-                {
-                    temp.push_back(points_image2.at(i));
-                    init_traj_list.at(i).push_back(points_image2.at(i));
-                }
-                else
+                    && points_image2.at(i).x < image_size.width-10 && points_image2.at(i).y < image_size.height-10)
                 {
-                    temp.push_back(points_image1.at(i));
+                    points_image1.at(i) = points_image2.at(i);
+                    tracks.extendTrack(i, points_image2.at(i));
                 }
             }
-            else
+            else if (j == pyramids.size() - 2 && index != -1)
             {
-                if (j == images.size() - 2)
-                {
-                    //std::cout << "in here " << std::endl;
-                    cv::Point2f start_point = points_image1.at(i);
-                    //std::cout << "start_point " << start_point.x << ", " << start_point.y << std::endl;
-                    cv::Vec4d &elem = optical_flow_vectors.at<cv::Vec4d> ((int)start_point.y, (int)start_point.x);
-                    elem[0] = -1.0;
-                    elem[1] = -1.0;
-                    elem[2] = 0.0;
-                    elem[3] = 0.0;
-                }
-                if (points_image1.at(i).x < 0.0 || points_image1.at(i).y < 0.0)
-                {
-                }
-                temp.push_back(points_image1.at(i));
+                optical_flow_vectors.setLost(index);
             }
         }
-        points_image1.clear();
-        for (int xyz=0;xyz<temp.size();xyz++)
-        {
-            points_image1.push_back(temp.at(xyz));
-        }
-        points_image2.clear();
-    }
-    for (int i = 0; i < init_traj_list.size(); i++)
-    {
-        if (init_traj_list.at(i).size() == images.size())
-        {
-            trajectories.push_back(init_traj_list.at(i));
-        }
-        else 
-        {
-            //std::cout << "size: " << init_traj_list.at(i).size() << std::endl;
-        }
     }
+    tracks.getTrajectories(trajectories);
     
     return num_vectors;
 }
@@ -261,7 +230,7 @@ int OpticalFlowCalculator::calculateOpticalFlowTrajectory(const std::vector<cv::
 
 
 
-int OpticalFlowCalculator::calculateCompensatedFlow(const cv::Mat &image1, const cv::Mat &image2, cv::Mat &optical_flow_vectors, int pixel_step)
+int OpticalFlowCalculator::calculateCompensatedFlow(const cv::Mat &image1, const cv::Mat &image2, FlowField &optical_flow_vectors, int pixel_step)
 {
     const int MAX_LEVEL = 2;
     cv::Size winSize(40, 40);
@@ -276,6 +245,8 @@ int OpticalFlowCalculator::calculateCompensatedFlow(const cv::Mat &image1, const
     cvtColor(image1, gray_image1, CV_BGR2GRAY);
     cvtColor(image2, gray_image2, CV_BGR2GRAY);
 
+    optical_flow_vectors.reset(image1.size(), pixel_step);
+
     std::vector<cv::Point2f> points_image1;
     std::vector<cv::Point2f> points_image2;
 
@@ -304,32 +275,18 @@ int OpticalFlowCalculator::calculateCompensatedFlow(const cv::Mat &image1, const
             float y_diff = end_point.y - start_point.y;
             if (std::abs(x_diff) > 1.0 || std::abs(y_diff) > 1.0)
             {
-                cv::Vec4d &elem = optical_flow_vectors.at<cv::Vec4d> ((int)start_point.y, (int)start_point.x);
-                elem[0] = start_point.x;
-                elem[1] = start_point.y;
-                elem[2] = x_diff;
-                elem[3] = y_diff;
-                //elem[2] = atan2(y_diff, x_diff);
-                //elem[3] = sqrt(x_diff*x_diff + y_diff*y_diff);
+                optical_flow_vectors.setVector(optical_flow_vectors.getIndex(start_point), start_point, cv::Point2f(x_diff, y_diff));
                 num_vectors++;
             }
             else
             {
-                cv::Vec4d &elem = optical_flow_vectors.at<cv::Vec4d> ((int)start_point.y, (int)start_point.x);
-                elem[0] = start_point.x;
-                elem[1] = start_point.y;
-                elem[2] = 0.0;
-                elem[3] = 0.0;
+                optical_flow_vectors.setVector(optical_flow_vectors.getIndex(start_point), start_point, cv::Point2f(0.0f, 0.0f));
             }
         }
         else
         {
             cv::Point2f start_point = points_image1.at(i);
-            cv::Vec4d &elem = optical_flow_vectors.at<cv::Vec4d> ((int)start_point.y, (int)start_point.x);
-            elem[0] = -1.0;
-            elem[1] = -1.0;
-            elem[2] = 0.0; 
-            elem[3] = 0.0;
+            optical_flow_vectors.setLost(optical_flow_vectors.getIndex(start_point));
         }
     }
 }
@@ -506,32 +463,27 @@ void OpticalFlowCalculator::drawMotionField(IplImage* imgU, IplImage* imgV, IplI
     
 }
 
-void OpticalFlowCalculator::writeFlow(const cv::Mat &optical_flow_vectors, const std::string &filename, int pixel_step)
+void OpticalFlowCalculator::writeFlow(const FlowField &optical_flow_vectors, const std::string &filename)
 {
     std::string horizontal_f = filename + "_h";
     std::string vertical_f = filename + "_f";
     ofstream hfile(horizontal_f);
     ofstream vfile(vertical_f);
-    for (int i = 0; i < optical_flow_vectors.rows; i = i + pixel_step)
+    const std::vector<float> &dx = optical_flow_vectors.getDX();
+    const std::vector<float> &dy = optical_flow_vectors.getDY();
+    for (int i = 0; i < optical_flow_vectors.rows(); i++)
     {
-        for (int j = 0; j < optical_flow_vectors.cols; j = j + pixel_step)
+        for (int j = 0; j < optical_flow_vectors.cols(); j++)
         {
             if (j != 0)
             {
                 hfile << ", ";
                 vfile << ", ";
             }
-            cv::Vec4d elem = optical_flow_vectors.at<cv::Vec4d>(i, j);
-            if (elem[0] == -1.0)
-            {
-                hfile << 0.0;
-                vfile << 0.0;
-            }
-            else
-            {
-                hfile << elem[2];
-                vfile << elem[3];
-            }
+            // lost cells have no displacement
+            int index = optical_flow_vectors.getIndex(i, j);
+            hfile << dx[index];
+            vfile << dy[index];
         }
         hfile << endl;
         vfile << endl;
@@ -20,19 +20,20 @@ OpticalFlowVisualizer::~OpticalFlowVisualizer()
 {    
 }
 
-void OpticalFlowVisualizer::showOpticalFlowVectors(const cv::Mat &original_image, cv::Mat &optical_flow_image, const cv::Mat &optical_flow_vectors, int pixel_step, cv::Scalar colour, double min_vector_size)
+void OpticalFlowVisualizer::showOpticalFlowVectors(const cv::Mat &original_image, cv::Mat &optical_flow_image, const FlowField &optical_flow_vectors, cv::Scalar colour, double min_vector_size)
 {
 
     original_image.copyTo(optical_flow_image);
 
-    for (int i = 0; i < optical_flow_vectors.rows; i++)
+    int pixel_step = optical_flow_vectors.getPixelStep();
+    for (int i = 0; i < optical_flow_vectors.rows(); i++)
     {
-        for (int j = 0; j < optical_flow_vectors.cols; j++)
+        for (int j = 0; j < optical_flow_vectors.cols(); j++)
         {
             cv::Point2f start_point;
             cv::Point2f end_point;
 
-            cv::Vec4d elem = optical_flow_vectors.at<cv::Vec4d>(i, j);
+            cv::Vec4d elem = optical_flow_vectors.getVector(optical_flow_vectors.getIndex(i, j));
 
             if ((std::abs(elem[2])> min_vector_size || std::abs(elem[3]) > min_vector_size) && std::abs(elem[2]) < pixel_step*5 && std::abs(elem[3]) < pixel_step*5) 
             {
@@ -135,19 +136,19 @@ void OpticalFlowVisualizer::showFlowClusters(const cv::Mat &original_image, cv::
     }
 }
 
-void OpticalFlowVisualizer::showFlowOutliers(const cv::Mat &original_image, cv::Mat &outlier_image, const cv::Mat &optical_flow_vectors, const cv::Mat &outlier_mask, int pixel_step, bool print)
+void OpticalFlowVisualizer::showFlowOutliers(const cv::Mat &original_image, cv::Mat &outlier_image, const FlowField &optical_flow_vectors, const cv::Mat &outlier_mask, bool print)
 {
 
     original_image.copyTo(outlier_image);
 
-    for (int i = 0; i < optical_flow_vectors.rows; i = i + pixel_step)
+    for (int i = 0; i < optical_flow_vectors.rows(); i++)
     {
-        for (int j = 0; j < optical_flow_vectors.cols; j = j + pixel_step)
+        for (int j = 0; j < optical_flow_vectors.cols(); j++)
         {
             cv::Point2f start_point;
             cv::Point2f end_point;
 
-            cv::Vec4d elem = optical_flow_vectors.at<cv::Vec4d>(i, j);
+            cv::Vec4d elem = optical_flow_vectors.getVector(optical_flow_vectors.getIndex(i, j));
             double outlier = outlier_mask.at<double>(i, j);
 
             if ((std::abs(elem[2])> 0.0 || std::abs(elem[3]) > 0.0))
@@ -222,9 +223,24 @@ std::vector<std::vector<cv::Point> > OpticalFlowVisualizer::showClusterContours(
 
 std::vector<cv::Rect> OpticalFlowVisualizer::showBoundingBoxes(const cv::Mat &original_image, cv::Mat &clusters_image, const std::vector<std::vector<cv::Point2f> > &clusters)
 {
-    std::vector<cv::Rect> rectangles;
+    std::vector<cv::Rect> rectangles = getBoundingBoxes(clusters);
+    drawBoundingBoxes(original_image, clusters_image, rectangles);
+    return rectangles;
+}
+
+void OpticalFlowVisualizer::drawBoundingBoxes(const cv::Mat &original_image, cv::Mat &clusters_image, const std::vector<cv::Rect> &rectangles)
+{
     cv::Scalar colour = CV_RGB(0, 0, 255);
     original_image.copyTo(clusters_image);
+    for (int i = 0; i < rectangles.size(); i++)
+    {
+        cv::rectangle(clusters_image, rectangles.at(i).tl(), rectangles.at(i).br(), colour, 2, 8, 0);
+    }
+}
+
+std::vector<cv::Rect> OpticalFlowVisualizer::getBoundingBoxes(const std::vector<std::vector<cv::Point2f> > &clusters)
+{
+    std::vector<cv::Rect> rectangles;
     for (int i = 0; i < clusters.size(); i++)
     {
         cv::Rect rect;
@@ -234,7 +250,6 @@ std::vector<cv::Rect> OpticalFlowVisualizer::showBoundingBoxes(const cv::Mat &or
         cv::Mat points_mat(clusteri);
         rect = cv::boundingRect(points_mat);
         rectangles.push_back(rect);
-        cv::rectangle(clusters_image, rect.tl(), rect.br(), colour, 2, 8, 0);
     }
     return rectangles;
 }
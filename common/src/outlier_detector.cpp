@@ -10,11 +10,16 @@
 #include <iostream>
 #include <Eigen/Dense>
 #include <cstdlib>
-#include <ctime>
+#include <algorithm>
+#include <random>
+#include <limits>
+#include <cmath>
+#include <cstring>
+#include <thread>
 
-OutlierDetector::OutlierDetector()
+OutlierDetector::OutlierDetector() : seed_(0), num_fits_(0), num_threads_(0), confidence_(0.99), max_iterations_(50),
+    max_trajectories_(0), warm_start_(false), warm_start_min_inlier_ratio_(0.5)
 {
-    srand (time(NULL));
     // TODO: read this from a file
     std::vector<double> p99;
     p99.push_back(0.0);
@@ -34,298 +39,803 @@ OutlierDetector::~OutlierDetector()
 {
 }
 
-void OutlierDetector::findOutliers(const cv::Mat &optical_flow_vectors, cv::Mat &outlier_probabilities, bool include_zeros, int pixel_step, bool print)
+void OutlierDetector::setRansacParameters(unsigned int seed, int num_threads, double confidence, int max_iterations)
 {
-    cv::Mat angle_matrix = cv::Mat::zeros(optical_flow_vectors.rows, optical_flow_vectors.cols, CV_64F);
-    cv::Mat magnitude_matrix = cv::Mat::zeros(optical_flow_vectors.rows, optical_flow_vectors.cols, CV_64F);
-    outlier_probabilities = cv::Mat::zeros(optical_flow_vectors.rows, optical_flow_vectors.cols, CV_64F);
-    
-    createAngleMatrix(optical_flow_vectors, angle_matrix, pixel_step);    
-    //if (print) std::cout << " Angle matrix " << std::endl << angle_matrix << std::endl;
-    createMagnitudeMatrix(optical_flow_vectors, magnitude_matrix, pixel_step);
-    //if (print) std::cout << " Magnitude matrix " << std::endl << magnitude_matrix << std::endl;
-    if (print ) std::cout << "angles " << std::endl;
-    createMask(optical_flow_vectors, angle_matrix, outlier_probabilities, include_zeros, pixel_step, print);
-    //if (print) std::cout << " Mask angle " << std::endl << outlier_probabilities << std::endl;
-    if (print ) std::cout << "lenghts " << std::endl;
-    createMask(optical_flow_vectors, magnitude_matrix, outlier_probabilities, include_zeros, pixel_step, print);
-    //if (print) std::cout << " Mask magn " << std::endl << outlier_probabilities << std::endl;
+    if (seed != seed_)
+    {
+        num_fits_ = 0;
+    }
+    seed_ = seed;
+    if (num_threads != num_threads_)
+    {
+        team_.reset();
+    }
+    num_threads_ = num_threads;
+    confidence_ = std::min(std::max(confidence, 0.0), 0.999999);
+    max_iterations_ = std::max(max_iterations, 1);
+}
+
+void OutlierDetector::setWarmStart(bool enabled, double min_inlier_ratio)
+{
+    if (!enabled)
+    {
+        previous_inliers_.clear();
+    }
+    warm_start_ = enabled;
+    warm_start_min_inlier_ratio_ = min_inlier_ratio;
+}
+
+void OutlierDetector::setMaxTrajectories(int max_trajectories)
+{
+    max_trajectories_ = std::max(max_trajectories, 0);
 }
 
-void OutlierDetector::getOutlierVectors(const cv::Mat &optical_flow_vectors, const cv::Mat &outlier_probabilities, cv::Mat &outlier_vectors, int pixel_step)
+void OutlierDetector::reset()
 {
+    previous_inliers_.clear();
+}
 
-    outlier_vectors = cv::Mat::zeros(optical_flow_vectors.rows, optical_flow_vectors.cols, CV_32FC4);
-    for (int i = 0; i < optical_flow_vectors.rows; i = i + pixel_step)
+void OutlierDetector::findOutliers(const FlowField &optical_flow_vectors, cv::Mat &outlier_probabilities, bool include_zeros, bool print)
+{
+    outlier_probabilities = cv::Mat::zeros(optical_flow_vectors.rows(), optical_flow_vectors.cols(), CV_64F);
+    if (optical_flow_vectors.empty())
     {
-        for (int j = 0; j < optical_flow_vectors.cols; j = j + pixel_step)
+        return;
+    }
+    int num_cells = optical_flow_vectors.size();
+    const float *dx = &optical_flow_vectors.getDX()[0];
+    const float *dy = &optical_flow_vectors.getDY()[0];
+
+    // vectorised float angle and magnitude of all cells at once
+    cv::Mat dx_plane(1, num_cells, CV_32F, const_cast<float *>(dx));
+    cv::Mat dy_plane(1, num_cells, CV_32F, const_cast<float *>(dy));
+    cv::cartToPolar(dx_plane, dy_plane, magnitudes_, angles_);
+    const float *angles = angles_.ptr<float>();
+    const float *magnitudes = magnitudes_.ptr<float>();
+
+    cells_.clear();
+    angle_values_.clear();
+    magnitude_values_.clear();
+    for (int i = 0; i < num_cells; i++)
+    {
+        if (include_zeros || dx[i] != 0.0f || dy[i] != 0.0f)
         {
-            if (outlier_probabilities.at<double>(i, j) > 0.5)
-            {
-                cv::Vec4d orig_vec = optical_flow_vectors.at<cv::Vec4d>(i, j);
-                cv::Vec4d &out_vec = outlier_vectors.at<cv::Vec4d>(i, j);
-                for (int i = 0; i < 4; i++) out_vec[i] = orig_vec[i];                    
-            }
+            cells_.push_back(i);
+            // same range as atan2, the statistics depend on where angles wrap
+            angle_values_.push_back(angles[i] > (float)CV_PI ? angles[i] - (float)(2.0 * CV_PI) : angles[i]);
+            magnitude_values_.push_back(magnitudes[i]);
+        }
+    }
+    if (cells_.empty())
+    {
+        return;
+    }
+
+    double angle_median, angle_limit;
+    double magnitude_median, magnitude_limit;
+    if (print) std::cout << "angles " << std::endl;
+    getRobustLimits(angle_values_, angle_median, angle_limit, print);
+    if (print) std::cout << "lengths " << std::endl;
+    getRobustLimits(magnitude_values_, magnitude_median, magnitude_limit, print);
+
+    // the mask is continuous and has one element per cell
+    double *mask = outlier_probabilities.ptr<double>();
+    for (int i = 0; i < cells_.size(); i++)
+    {
+        if (std::abs(angle_values_[i] - angle_median) > angle_limit ||
+            std::abs(magnitude_values_[i] - magnitude_median) > magnitude_limit)
+        {
+            mask[cells_[i]] = 1.0;
         }
     }
 }
 
-void OutlierDetector::createAngleMatrix(const cv::Mat &optical_flow_vectors, cv::Mat &angle_matrix, int pixel_step)
+void OutlierDetector::getOutlierVectors(const FlowField &optical_flow_vectors, const cv::Mat &outlier_probabilities, FlowField &outlier_vectors)
 {
-    for (int i = 0; i < optical_flow_vectors.rows; i = i + pixel_step)
+    outlier_vectors.reset(optical_flow_vectors.getImageSize(), optical_flow_vectors.getPixelStep());
+    for (int i = 0; i < optical_flow_vectors.rows(); i++)
     {
-        for (int j = 0; j < optical_flow_vectors.cols; j = j + pixel_step)
+        for (int j = 0; j < optical_flow_vectors.cols(); j++)
         {
-            cv::Vec4d elem = optical_flow_vectors.at<cv::Vec4d>(i, j);
-            angle_matrix.at<double>(i, j) = std::atan2(elem[3], elem[2]);
+            int index = optical_flow_vectors.getIndex(i, j);
+            if (outlier_probabilities.at<double>(i, j) > 0.5 && optical_flow_vectors.isValid(index))
+            {
+                cv::Vec4d vec = optical_flow_vectors.getVector(index);
+                outlier_vectors.setVector(index, cv::Point2f(vec[0], vec[1]), cv::Point2f(vec[2], vec[3]));
+            }
         }
     }
 }
 
-void OutlierDetector::createMagnitudeMatrix(const cv::Mat &optical_flow_vectors, cv::Mat &magnitude_matrix, int pixel_step)
+double OutlierDetector::getMedian(std::vector<float> &vals)
+{
+    std::vector<float>::iterator middle = vals.begin() + vals.size() / 2;
+    std::nth_element(vals.begin(), middle, vals.end());
+    double median = *middle;
+    if (vals.size() % 2 == 0)
+    {
+        // the lower middle is the largest element of the lower half
+        median = (median + *std::max_element(vals.begin(), middle)) / 2.0;
+    }
+    return median;
+}
+
+void OutlierDetector::getRobustLimits(const std::vector<float> &values, double &median, double &limit, bool print)
 {
-    for (int i = 0; i < optical_flow_vectors.rows; i = i + pixel_step)
+    deviations_.assign(values.begin(), values.end());
+    median = getMedian(deviations_);
+    for (int i = 0; i < values.size(); i++)
     {
-        for (int j = 0; j < optical_flow_vectors.cols; j = j + pixel_step)
+        deviations_[i] = std::abs(values[i] - median);
+    }
+    double median_absolute_deviation = getMedian(deviations_);
+    // modified z-score 0.6745 * deviation / MAD above 3.5
+    double threshold = 3.5;
+    limit = threshold * median_absolute_deviation / 0.6745;
+    if (print) std::cout << "median: " << median << " MAD: " << median_absolute_deviation << std::endl;
+}
+
+/**
+ * Trajectories as the columns of a column-major matrix, even rows are x
+ * coordinates and odd rows are y coordinates, oldest point first. A
+ * TrackStore is mapped without copying it.
+ */
+typedef Eigen::Map<const Eigen::MatrixXf> TrajectoryMatrix;
+
+cv::Point2f getTrajectoryPoint(const TrajectoryMatrix &data, int column, int index)
+{
+    return cv::Point2f(data(index * 2, column), data(index * 2 + 1, column));
+}
+
+cv::Point2f getLastPoint(const TrajectoryMatrix &data, int column)
+{
+    return getTrajectoryPoint(data, column, data.rows() / 2 - 1);
+}
+
+void fillMatrix(const std::vector<std::vector<cv::Point2f> > &trajectories, Eigen::MatrixXf &data)
+{
+    for (int i = 0; i < trajectories.size(); i++)
+    {
+        const std::vector<cv::Point2f> &trajectory = trajectories.at(i);
+        for (int j = 0; j < trajectory.size(); j++)
         {
-            cv::Vec4d elem = optical_flow_vectors.at<cv::Vec4d>(i, j);
-            magnitude_matrix.at<double>(i, j) = std::sqrt(elem[3]*elem[3] + elem[2]*elem[2]);
+            data(j * 2, i) = trajectory.at(j).x;
+            data((j * 2) + 1, i) = trajectory.at(j).y;
         }
     }
 }
 
-double OutlierDetector::getMedian(std::vector<double> vals, bool print)
+/**
+ * The mean of the first points, repeated for every point of a trajectory.
+ * The fit works on the trajectories minus this offset without forming them.
+ */
+void getMean(const TrajectoryMatrix &data, Eigen::VectorXf &mean)
 {
-    sort(vals.begin(), vals.end());
-    if (print)
+    float x_mean = data.row(0).mean();
+    float y_mean = data.row(1).mean();
+    mean.resize(data.rows());
+    for (int i = 0; i < data.rows(); i += 2)
     {
-        std::cout << "Calculating median for " << std::endl;
-        for (int i = 0; i < vals.size(); i++)
+        mean(i) = x_mean;
+        mean(i + 1) = y_mean;
+    }
+}
+
+/**
+ * Trajectories that hypotheses are drawn from, grouped by where they end in
+ * the image. Drawing a cell first spreads the samples over the image instead
+ * of concentrating them where most points are tracked.
+ */
+struct SamplingStrata
+{
+    std::vector<std::vector<int> > cells;
+    // only when there are fewer candidates than samples
+    bool allow_duplicates;
+};
+
+/**
+ * Sum of the second differences of a trajectory. Tracks that jitter or jump
+ * are likely tracking errors and make poor samples.
+ */
+double getRoughness(const TrajectoryMatrix &data, int column)
+{
+    double roughness = 0.0;
+    for (int j = 2; j + 3 < data.rows(); j += 2)
+    {
+        double ax = data(j + 2, column) - 2.0 * data(j, column) + data(j - 2, column);
+        double ay = data(j + 3, column) - 2.0 * data(j + 1, column) + data(j - 1, column);
+        roughness += std::sqrt(ax * ax + ay * ay);
+    }
+    return roughness;
+}
+
+/**
+ * Groups the given trajectories into a grid of grid_size x grid_size cells
+ * over the bounding box of their last points. Only non-empty cells are
+ * returned, each in the order of indices.
+ */
+void binByLastPoint(const TrajectoryMatrix &data, const std::vector<int> &indices, int grid_size, std::vector<std::vector<int> > &cells)
+{
+    cells.clear();
+    if (indices.empty())
+    {
+        return;
+    }
+    cv::Point2f first_point = getLastPoint(data, indices.at(0));
+    float min_x = first_point.x, max_x = first_point.x, min_y = first_point.y, max_y = first_point.y;
+    for (int i = 0; i < indices.size(); i++)
+    {
+        cv::Point2f point = getLastPoint(data, indices.at(i));
+        min_x = std::min(min_x, point.x);
+        max_x = std::max(max_x, point.x);
+        min_y = std::min(min_y, point.y);
+        max_y = std::max(max_y, point.y);
+    }
+    float cell_width = std::max((max_x - min_x) / grid_size, 1.0f);
+    float cell_height = std::max((max_y - min_y) / grid_size, 1.0f);
+
+    std::vector<std::vector<int> > grid(grid_size * grid_size);
+    for (int i = 0; i < indices.size(); i++)
+    {
+        cv::Point2f point = getLastPoint(data, indices.at(i));
+        int column = std::min(static_cast<int>((point.x - min_x) / cell_width), grid_size - 1);
+        int row = std::min(static_cast<int>((point.y - min_y) / cell_height), grid_size - 1);
+        grid.at(row * grid_size + column).push_back(indices.at(i));
+    }
+    for (int i = 0; i < grid.size(); i++)
+    {
+        if (!grid.at(i).empty())
         {
-            std::cout << vals.at(i) << ", ";
+            cells.push_back(grid.at(i));
         }
-        std::cout << std::endl;
     }
-    double median = 0.0;
-    if (vals.size() % 2 == 0)
+}
+
+/**
+ * Picks at most max_trajectories trajectories spread evenly over the image:
+ * every cell of a grid gets an equal share, cells with fewer trajectories
+ * give their unused share to the others, and each cell is subsampled with
+ * a constant stride.
+ */
+void selectStratifiedSubset(const TrajectoryMatrix &data, int max_trajectories, std::vector<int> &columns)
+{
+    int grid_size = 8;
+    std::vector<int> indices(data.cols());
+    for (int i = 0; i < data.cols(); i++)
     {
-        median = (vals[(vals.size() / 2) - 1] + vals[vals.size() / 2]) / 2.0;        
+        indices.at(i) = i;
     }
-    else
+    std::vector<std::vector<int> > cells;
+    binByLastPoint(data, indices, grid_size, cells);
+
+    // fill the smallest cells first
+    std::vector<std::pair<int, int> > cell_sizes(cells.size());
+    for (int i = 0; i < cells.size(); i++)
     {
-        median = vals[(vals.size()-1) / 2];
+        cell_sizes.at(i) = std::make_pair(cells.at(i).size(), i);
     }
-    return median;
+    std::sort(cell_sizes.begin(), cell_sizes.end());
+    std::vector<int> quota(cells.size());
+    int remaining = max_trajectories;
+    for (int i = 0; i < cell_sizes.size(); i++)
+    {
+        int share = remaining / (cell_sizes.size() - i);
+        quota.at(cell_sizes.at(i).second) = std::min(cell_sizes.at(i).first, share);
+        remaining -= quota.at(cell_sizes.at(i).second);
+    }
+
+    columns.clear();
+    for (int i = 0; i < cells.size(); i++)
+    {
+        const std::vector<int> &cell = cells.at(i);
+        for (int j = 0; j < quota.at(i); j++)
+        {
+            columns.push_back(cell.at(static_cast<long>(j) * cell.size() / quota.at(i)));
+        }
+    }
+    std::sort(columns.begin(), columns.end());
 }
-void OutlierDetector::createMask(const cv::Mat &optical_flow_vectors, const cv::Mat &values, cv::Mat &mask, bool include_zeros, int pixel_step, bool print)
+
+/**
+ * Sorts the smooth trajectories into a grid of cells by their last point.
+ * If too few of them are smooth all trajectories are candidates.
+ */
+void createStrata(const TrajectoryMatrix &data, int num_sample_points, SamplingStrata &strata)
 {
-    std::vector<double> vals;
-    for (int i = 0; i < optical_flow_vectors.rows; i = i + pixel_step)
+    int grid_size = 4;
+    double max_roughness_factor = 3.0;
+    double min_roughness_threshold = 1.0;
+
+    std::vector<double> roughness(data.cols());
+    for (int i = 0; i < data.cols(); i++)
+    {
+        roughness.at(i) = getRoughness(data, i);
+    }
+    std::vector<double> sorted_roughness(roughness);
+    std::nth_element(sorted_roughness.begin(), sorted_roughness.begin() + sorted_roughness.size() / 2, sorted_roughness.end());
+    double roughness_threshold = std::max(max_roughness_factor * sorted_roughness.at(sorted_roughness.size() / 2), min_roughness_threshold);
+
+    std::vector<int> candidates;
+    for (int i = 0; i < data.cols(); i++)
     {
-        for (int j = 0; j < optical_flow_vectors.cols; j = j + pixel_step)
+        if (roughness.at(i) <= roughness_threshold)
         {
-            double elem = values.at<double>(i, j);
-            cv::Vec4d e = optical_flow_vectors.at<cv::Vec4d>(i, j);
-            if (print) std::cout << e << ", " << elem << std::endl;
-            if (include_zeros)
-            {
-                vals.push_back(elem);
-            }
-            else if (std::abs(e[2]) > 0.0 || std::abs(e[3]) > 0.0)
-            {
-                vals.push_back(elem);
-            }
+            candidates.push_back(i);
         }
-    }    
-    if (vals.empty())
+    }
+    if (candidates.size() < num_sample_points)
     {
-        return;
+        candidates.resize(data.cols());
+        for (int i = 0; i < data.cols(); i++)
+        {
+            candidates.at(i) = i;
+        }
     }
-    double median = getMedian(vals, print);
-    if (print) std::cout << "median: " << median  << std::endl;
-    std::vector<double> diff;
-    for (int i = 0; i < vals.size(); i++)
+    strata.allow_duplicates = candidates.size() < num_sample_points;
+
+    binByLastPoint(data, candidates, grid_size, strata.cells);
+}
+
+void fillSubset(const TrajectoryMatrix &data, const Eigen::VectorXf &mean, const SamplingStrata &strata, Eigen::MatrixXf &subset, std::vector<int> &column_indices, std::mt19937 &rng)
+{
+    std::uniform_int_distribution<int> cell_distribution(0, strata.cells.size() - 1);
+    column_indices.clear();
+    while (column_indices.size() < subset.cols())
     {
-        diff.push_back(std::abs(vals.at(i) - median));
-       // std::cout << fabs(vals.at(i) - median) << std::endl;
-    }    
-    double median_absolute_deviation = getMedian(diff, print);
-    if (print) std::cout << "MAD: " << median_absolute_deviation  << std::endl;
-    double threshold = 3.5;
-    int index = 0;
+        const std::vector<int> &cell = strata.cells.at(cell_distribution(rng));
+        std::uniform_int_distribution<int> member(0, cell.size() - 1);
+        int column_number = cell.at(member(rng));
+        if (!strata.allow_duplicates &&
+            std::find(column_indices.begin(), column_indices.end(), column_number) != column_indices.end())
+        {
+            continue;
+        }
+        subset.col(column_indices.size()) = data.col(column_number) - mean;
+        column_indices.push_back(column_number);
+    }
+}
 
-    if (print) std::cout << "diff: " << std::endl;
-    for (int i = 0; i < optical_flow_vectors.rows; i = i + pixel_step)
+/**
+ * Orthonormal basis of the columns of subset by modified Gram-Schmidt,
+ * written into basis (same size as subset). Columns that are linearly
+ * dependent on the previous ones are replaced by unit vectors so the basis
+ * always has d columns, like the leading left singular vectors of a full SVD.
+ */
+void orthonormalize(const Eigen::MatrixXf &subset, Eigen::MatrixXf &basis)
+{
+    float tolerance = 1e-4f * std::max(subset.cwiseAbs().maxCoeff(), 1.0f);
+    int next_unit_vector = 0;
+    for (int k = 0; k < subset.cols(); k++)
     {
-        for (int j = 0; j < optical_flow_vectors.cols; j = j + pixel_step)
+        basis.col(k) = subset.col(k);
+        float scale = tolerance;
+        while (true)
         {
-            double val = values.at<double>(i, j);
-            cv::Vec4d e = optical_flow_vectors.at<cv::Vec4d>(i, j);
-            if (include_zeros)
+            // twice is enough to keep the basis orthogonal in float
+            for (int pass = 0; pass < 2; pass++)
             {
-                double modified_z_score = 0.6745 * diff.at(index) / median_absolute_deviation;
-                if (std::abs(modified_z_score) > threshold)
+                for (int j = 0; j < k; j++)
                 {
-                    mask.at<double>(i, j) = 1.0;
+                    basis.col(k) -= basis.col(j).dot(basis.col(k)) * basis.col(j);
                 }
-                index++;
             }
-            else if (std::abs(e[2]) > 0.0 || std::abs(e[3]) > 0.0)
+            float norm = basis.col(k).norm();
+            if (norm > scale)
             {
-                double modified_z_score = 0.6745 * diff.at(index) / median_absolute_deviation;
-                if (print) std::cout << modified_z_score << std::endl;
-                if (std::abs(modified_z_score) > threshold)
-                {
-                    mask.at<double>(i, j) = 1.0;
-                    if (print) std::cout << i << ", " << j << ", " << mask.at<double>(i, j) << std::endl;
-                }
-                index++;
+                basis.col(k) /= norm;
+                break;
             }
+            basis.col(k).setZero();
+            basis(next_unit_vector++ % basis.rows(), k) = 1.0f;
+            scale = 0.1f;
         }
     }
 }
 
-void fillMatrix(const std::vector<std::vector<cv::Point2f> > &trajectories, Eigen::MatrixXf &data)
+/**
+ * Buffers for generating and scoring hypotheses, allocated once per fit so
+ * that the RANSAC loop itself does not allocate
+ */
+struct SubspaceWorkspace
 {
-    // TODO: find a better way to do this
-    for (int i = 0; i < trajectories.size(); i++)
+    // residuals are computed for this many trajectories at a time, so the
+    // scratch buffers do not grow with the number of trajectories
+    static const int BLOCK_SIZE = 256;
+
+    // sampled trajectories and their orthonormal basis (n x d)
+    Eigen::MatrixXf subset;
+    Eigen::MatrixXf basis;
+    std::vector<int> column_indices;
+    // a block of mean subtracted trajectories (n x BLOCK_SIZE)
+    Eigen::MatrixXf centred;
+    // their coordinates in the hypothesis basis (d x BLOCK_SIZE)
+    Eigen::MatrixXf projection;
+    Eigen::VectorXf residual;
+
+    void resize(const TrajectoryMatrix &data, int num_basis_vectors)
     {
-        std::vector<cv::Point2f> trajectory = trajectories.at(i);
-        for (int j = 0; j < trajectory.size(); j++)
-        {
-            data(j * 2, i) = trajectory.at(j).x;     
-            data((j * 2) + 1, i) = trajectory.at(j).y;     
-        }
+        subset.resize(data.rows(), num_basis_vectors);
+        basis.resize(data.rows(), num_basis_vectors);
+        column_indices.reserve(num_basis_vectors);
+        centred.resize(data.rows(), BLOCK_SIZE);
+        projection.resize(num_basis_vectors, BLOCK_SIZE);
+        residual.resize(data.cols());
+    }
+};
+
+/**
+ * Residual of every mean subtracted trajectory x against the subspace
+ * spanned by the orthonormal columns of basis, |x - U U^T x|^2. This equals
+ * the diagonal of data^T * Pnd * data without forming Pnd or the N x N
+ * product. It is not computed as |x|^2 - |U^T x|^2 since that cancels badly
+ * in float for pixel coordinates.
+ */
+void computeResiduals(const TrajectoryMatrix &data, const Eigen::VectorXf &mean, const Eigen::MatrixXf &basis, SubspaceWorkspace &workspace)
+{
+    for (int begin = 0; begin < data.cols(); begin += SubspaceWorkspace::BLOCK_SIZE)
+    {
+        int num_columns = std::min<int>(SubspaceWorkspace::BLOCK_SIZE, data.cols() - begin);
+        Eigen::Block<Eigen::MatrixXf, Eigen::Dynamic, Eigen::Dynamic, true> centred = workspace.centred.leftCols(num_columns);
+        Eigen::Block<Eigen::MatrixXf, Eigen::Dynamic, Eigen::Dynamic, true> projection = workspace.projection.leftCols(num_columns);
+        centred = data.middleCols(begin, num_columns).colwise() - mean;
+        projection.noalias() = basis.transpose() * centred;
+        centred.noalias() -= basis * projection;
+        workspace.residual.segment(begin, num_columns) = centred.colwise().squaredNorm().transpose();
+    }
+}
+
+/**
+ * Seed of the random stream of a hypothesis, mixed from the fit seed and the
+ * hypothesis number by a splitmix64 step
+ */
+unsigned int getHypothesisSeed(unsigned int seed, int hypothesis)
+{
+    unsigned long long z = ((static_cast<unsigned long long>(seed) << 32) | static_cast<unsigned int>(hypothesis)) + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return static_cast<unsigned int>(z ^ (z >> 31));
+}
+
+/**
+ * Draws hypothesis number hypothesis and computes its residuals. Every
+ * hypothesis has its own random stream, so it does not matter which thread
+ * generates it or in which order.
+ */
+void generateHypothesis(const TrajectoryMatrix &data, const Eigen::VectorXf &mean, const SamplingStrata &strata, unsigned int seed, int hypothesis, SubspaceWorkspace &workspace)
+{
+    std::mt19937 rng(getHypothesisSeed(seed, hypothesis));
+    fillSubset(data, mean, strata, workspace.subset, workspace.column_indices, rng);
+    orthonormalize(workspace.subset, workspace.basis);
+    computeResiduals(data, mean, workspace.basis, workspace);
+}
+
+// counts the inliers of hypotheses first, first + step, ... up to end
+void scoreHypotheses(const TrajectoryMatrix &data, const Eigen::VectorXf &mean, const SamplingStrata &strata, unsigned int seed, int first, int end, int step, double inlier_threshold, SubspaceWorkspace &workspace, std::vector<int> &num_inliers)
+{
+    for (int h = first; h < end; h += step)
+    {
+        generateHypothesis(data, mean, strata, seed, h, workspace);
+        num_inliers.at(h) = (workspace.residual.array() < inlier_threshold).count();
+    }
+}
+
+/**
+ * Orthonormal basis of the d-dimensional subspace that fits the given
+ * columns best, the leading eigenvectors of their scatter matrix
+ */
+void fitBasis(const TrajectoryMatrix &data, const Eigen::VectorXf &mean, const std::vector<int> &columns, Eigen::MatrixXf &basis)
+{
+    Eigen::MatrixXf scatter = Eigen::MatrixXf::Zero(data.rows(), data.rows());
+    Eigen::VectorXf trajectory(data.rows());
+    for (int i = 0; i < columns.size(); i++)
+    {
+        trajectory = data.col(columns.at(i)) - mean;
+        scatter.selfadjointView<Eigen::Lower>().rankUpdate(trajectory);
     }
+    // eigenvalues are sorted in increasing order
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXf> solver(scatter.selfadjointView<Eigen::Lower>());
+    basis = solver.eigenvectors().rightCols(basis.cols());
 }
 
-void meanSubtract(Eigen::MatrixXf &data)
+/**
+ * Local optimisation: refits the basis to the inliers until the inlier set
+ * stops growing. Returns the number of inliers of the last basis, whose
+ * residuals are left in the workspace.
+ */
+int refineSubspace(const TrajectoryMatrix &data, const Eigen::VectorXf &mean, std::vector<int> inliers, double inlier_threshold, SubspaceWorkspace &workspace)
 {
-    double x_sum = data.row(0).sum();
-    double y_sum = data.row(1).sum();
-    x_sum /= data.cols();
-    y_sum /= data.cols();
-    Eigen::MatrixXf xsum = Eigen::MatrixXf::Constant(1, data.cols(), x_sum); 
-    Eigen::MatrixXf ysum = Eigen::MatrixXf::Constant(1, data.cols(), y_sum); 
-    for (int i = 0; i < data.rows(); i++)
+    int max_steps = 3;
+    int num_points = 0;
+    for (int step = 0; step < max_steps; step++)
     {
-        if (i % 2 == 0)
+        fitBasis(data, mean, inliers, workspace.basis);
+        computeResiduals(data, mean, workspace.basis, workspace);
+        int previous_num_points = num_points;
+        inliers.clear();
+        for (int i = 0; i < workspace.residual.size(); i++)
         {
-            data.row(i) = data.row(i) - xsum;
+            if (workspace.residual(i) < inlier_threshold)
+            {
+                inliers.push_back(i);
+            }
         }
-        else
+        num_points = inliers.size();
+        if (num_points <= previous_num_points || num_points < workspace.basis.cols())
         {
-            data.row(i) = ysum - data.row(i);
+            break;
         }
     }
+    return num_points;
 }
 
-std::vector<int> fillSubset(const Eigen::MatrixXf &data, Eigen::MatrixXf &subset, int num_columns)
+// trajectories are matched between windows by their points, which the
+// tracker copies unchanged from one window to the next
+unsigned long long getPointKey(const cv::Point2f &point)
 {
-    std::vector<int> column_indices;
-    for(int i = 0; i < num_columns; i++)
+    unsigned int x, y;
+    std::memcpy(&x, &point.x, sizeof(x));
+    std::memcpy(&y, &point.y, sizeof(y));
+    return (static_cast<unsigned long long>(x) << 32) | y;
+}
+
+/**
+ * Number of hypotheses needed to draw one sample of only inliers with the
+ * given confidence, log(1 - p) / log(1 - w^d)
+ */
+int getRequiredIterations(double inlier_ratio, int num_sample_points, double confidence)
+{
+    double all_inliers = std::pow(inlier_ratio, num_sample_points);
+    if (all_inliers >= 1.0)
     {
-        int column_number = rand() % data.cols();
-        column_indices.push_back(column_number);
-        subset.col(i) = data.col(column_number);        
-        //subset.col(i) = data.col(100 + i);        
+        return 0;
+    }
+    if (all_inliers <= 0.0)
+    {
+        return std::numeric_limits<int>::max();
     }
-    return column_indices;
+    double iterations = std::ceil(std::log(1.0 - confidence) / std::log(1.0 - all_inliers));
+    return iterations < std::numeric_limits<int>::max() ? static_cast<int>(iterations) : std::numeric_limits<int>::max();
 }
 
 std::vector<std::vector<cv::Point2f> > OutlierDetector::fitSubspace(const std::vector<std::vector<cv::Point2f> > &trajectories, std::vector<cv::Point2f> &outlier_points, int num_motions, double sigma)
+{
+    std::vector<std::vector<cv::Point2f> > trajectory_subspace_vectors;
+    if (trajectories.empty())
+    {
+        return trajectory_subspace_vectors;
+    }
+    Eigen::MatrixXf data(trajectories.at(0).size() * 2, trajectories.size());
+    fillMatrix(trajectories, data);
+
+    std::vector<int> outlier_columns;
+    std::vector<int> subspace_columns;
+    fitTrajectoryMatrix(data.data(), data.rows(), data.cols(), num_motions, sigma, outlier_columns, subspace_columns);
+    for (int i = 0; i < outlier_columns.size(); i++)
+    {
+        const std::vector<cv::Point2f> &trajectory = trajectories.at(outlier_columns.at(i));
+        outlier_points.push_back(trajectory.at(trajectory.size() - 2));
+    }
+    for (int i = 0; i < subspace_columns.size(); i++)
+    {
+        trajectory_subspace_vectors.push_back(trajectories.at(subspace_columns.at(i)));
+    }
+    return trajectory_subspace_vectors;
+}
+
+std::vector<std::vector<cv::Point2f> > OutlierDetector::fitSubspace(const TrackStore &tracks, std::vector<cv::Point2f> &outlier_points, int num_motions, double sigma)
+{
+    std::vector<std::vector<cv::Point2f> > trajectory_subspace_vectors;
+    int num_trajectories = tracks.getNumCompleteTracks();
+    if (num_trajectories == 0)
+    {
+        return trajectory_subspace_vectors;
+    }
+    int window_size = tracks.getWindowSize();
+
+    std::vector<int> outlier_columns;
+    std::vector<int> subspace_columns;
+    fitTrajectoryMatrix(tracks.getData(), window_size * 2, num_trajectories, num_motions, sigma, outlier_columns, subspace_columns);
+    for (int i = 0; i < outlier_columns.size(); i++)
+    {
+        outlier_points.push_back(tracks.getPoint(outlier_columns.at(i), window_size - 2));
+    }
+    for (int i = 0; i < subspace_columns.size(); i++)
+    {
+        std::vector<cv::Point2f> trajectory(window_size);
+        for (int j = 0; j < window_size; j++)
+        {
+            trajectory.at(j) = tracks.getPoint(subspace_columns.at(i), j);
+        }
+        trajectory_subspace_vectors.push_back(trajectory);
+    }
+    return trajectory_subspace_vectors;
+}
+
+void OutlierDetector::fitTrajectoryMatrix(const float *points, int num_rows, int num_trajectories, int num_motions, double sigma, std::vector<int> &outlier_columns, std::vector<int> &subspace_columns)
 {
     bool print = false;
-    int subspace_dimensions = trajectories[0].size() * 2; // n
-    int num_trajectories = trajectories.size();
+    int subspace_dimensions = num_rows; // n
     // each column in data represents one trajectory
     // even rows are x coordinates, odd rows are y coordinates
-    Eigen::MatrixXf data(subspace_dimensions, num_trajectories);
-    if (print) std::cout << "fill matrix " << std::endl;
-    fillMatrix(trajectories, data);
-    if (print) std::cout << "mean subtract " << std::endl;
-    meanSubtract(data);
+    TrajectoryMatrix data(points, num_rows, num_trajectories);
+    Eigen::VectorXf mean;
+    getMean(data, mean);
 
     int num_sample_points = 4 * num_motions; // d
-    int num_iterations = 50;
+    int batch_size = 8;
+    // every fit draws its hypotheses from its own streams
+    unsigned int fit_seed = getHypothesisSeed(seed_, num_fits_++);
+    double inlier_threshold = (subspace_dimensions - num_sample_points) * sigma * sigma;
     
+    // the model is fitted on at most max_trajectories_ trajectories spread
+    // over the image, and all of them are classified against it afterwards
+    bool subsampled = max_trajectories_ > 0 && num_trajectories > max_trajectories_;
+    std::vector<int> fit_columns;
+    Eigen::MatrixXf sampled_data;
+    if (subsampled)
+    {
+        selectStratifiedSubset(data, max_trajectories_, fit_columns);
+        sampled_data.resize(subspace_dimensions, fit_columns.size());
+        for (int i = 0; i < fit_columns.size(); i++)
+        {
+            sampled_data.col(i) = data.col(fit_columns.at(i));
+        }
+    }
+    TrajectoryMatrix fit_data(subsampled ? sampled_data.data() : points, num_rows, subsampled ? sampled_data.cols() : num_trajectories);
+    int num_fit_trajectories = fit_data.cols();
+
     Eigen::VectorXf final_residual;
+    Eigen::MatrixXf final_basis;
     std::vector<int> final_columns;
     int max_points = 0;
 
-    if (print) std::cout << " start iterations " << std::endl;
-    for (int i = 0; i < num_iterations; i++)
-    {
-        Eigen::MatrixXf subset(subspace_dimensions, num_sample_points); 
-        if (print) std::cout << "file subset " << std::endl;
-        std::vector<int> column_indices;
-        column_indices = fillSubset(data, subset, num_sample_points);
-
-        if (print) std::cout << "svd calculation " << std::endl;
-//        Eigen::JacobiSVD<Eigen::MatrixXf> svd(subset, Eigen::ComputeFullU | Eigen::ComputeFullV);
-        Eigen::JacobiSVD<Eigen::MatrixXf, Eigen::FullPivHouseholderQRPreconditioner> svd(subset,  Eigen::ComputeFullU | Eigen::ComputeFullV);
-
-        if (print) std::cout << "init Pnd " << std::endl;
-        Eigen::MatrixXf Pnd = Eigen::MatrixXf::Zero(subspace_dimensions, subspace_dimensions);
-        //std::cout << "U" << std::endl;
-        //std::cout << svd.matrixU() << std::endl;
-        //std::cout << svd.singularValues() << std::endl;
-        
-        if (print) std::cout << "calc M " << std::endl;
-        for (int idx = 0; idx < num_sample_points; idx++)
+    // the window moved by one frame, so a trajectory that was an inlier ends
+    // where it ended before, one point before its end
+    std::vector<int> previous_inliers;
+    if (warm_start_ && num_rows > 2)
+    {
+        for (int i = 0; i < num_fit_trajectories; i++)
         {
-            Eigen::VectorXf u = svd.matrixU().col(idx);
-            Eigen::MatrixXf M = u*u.transpose();
-            Pnd = Pnd + M;
+            if (previous_inliers_.count(getPointKey(getTrajectoryPoint(fit_data, i, num_rows / 2 - 2))) > 0)
+            {
+                previous_inliers.push_back(i);
+            }
         }
-        if (print) std::cout << "calc Pnd " << std::endl;
-        Pnd = Eigen::MatrixXf::Identity(subspace_dimensions, subspace_dimensions) - Pnd;
-
-        Eigen::MatrixXf data_T = data.transpose();
-        if (print) std::cout << "calc residual " << std::endl;
-        Eigen::VectorXf residual = (data_T * (Pnd * data)).diagonal();
-        if (print) std::cout << "residual : " << std::endl;
-        if (print) std::cout << residual << std::endl;
-        residual = residual.cwiseAbs();
-        int num_points = 0;
-        for (int idx = 0; idx < residual.size(); idx++)
+    }
+    if (previous_inliers.size() >= 2 * num_sample_points)
+    {
+        SubspaceWorkspace workspace;
+        workspace.resize(fit_data, num_sample_points);
+        int num_points = refineSubspace(fit_data, mean, previous_inliers, inlier_threshold, workspace);
+        if (num_points >= warm_start_min_inlier_ratio_ * num_fit_trajectories)
         {
-            if (print) std::cout << "threshold " << (subspace_dimensions - num_sample_points) * sigma * sigma << std::endl;
-            if (residual(idx) < (subspace_dimensions - num_sample_points) * sigma * sigma)
+            max_points = num_points;
+            final_residual = workspace.residual;
+            final_basis = workspace.basis;
+            // the best fitting trajectories stand in for the sampled ones
+            std::vector<std::pair<float, int> > fits(num_fit_trajectories);
+            for (int i = 0; i < num_fit_trajectories; i++)
+            {
+                fits.at(i) = std::make_pair(final_residual(i), i);
+            }
+            std::partial_sort(fits.begin(), fits.begin() + std::min(num_sample_points, num_fit_trajectories), fits.end());
+            for (int i = 0; i < num_sample_points && i < num_fit_trajectories; i++)
             {
-                if (print) std::cout << "adding  " << std::endl;
-                num_points++;
+                final_columns.push_back(fits.at(i).second);
             }
         }
-        if (num_points > max_points)
+        if (print) std::cout << "warm start with " << previous_inliers.size() << " trajectories: " << num_points << " inliers" << std::endl;
+    }
+    if (max_points == 0)
+    {
+        SamplingStrata strata;
+        createStrata(fit_data, num_sample_points, strata);
+
+        // starting threads does not pay off for small fits
+        int min_trajectories_per_thread = 250;
+        int num_threads = num_threads_ > 0 ? num_threads_ : std::thread::hardware_concurrency();
+        num_threads = std::min(num_threads, num_fit_trajectories / min_trajectories_per_thread);
+        num_threads = std::max(1, std::min(num_threads, batch_size));
+
+        // the threads are kept from fit to fit and only replaced by a larger
+        // team; the workspaces are set up once per fit
+        if (num_threads > 1 && (!team_ || team_->size() < num_threads))
         {
-            if (print) std::cout << num_points << " to " << max_points << std::endl;
-            if (print) std::cout << "copy residual" << residual << std::endl;
-            max_points = num_points;
-            final_residual = residual;
-            final_columns = column_indices;
-            if (print) std::cout << "copy final residual " << final_residual << std::endl;
+            team_.reset(new WorkerTeam(num_threads));
+        }
+        std::vector<SubspaceWorkspace> workspaces(num_threads);
+        for (int t = 0; t < num_threads; t++)
+        {
+            workspaces.at(t).resize(fit_data, num_sample_points);
+        }
+
+        // hypotheses are scored in batches of a fixed size and the stopping rule
+        // is only checked between batches, so the thread count does not change
+        // which hypotheses are scored
+        std::vector<int> num_inliers(max_iterations_, 0);
+        int num_iterations = 0;
+        int required_iterations = max_iterations_;
+        int best_hypothesis = 0;
+        while (num_iterations < std::min(required_iterations, max_iterations_))
+        {
+            int batch_begin = num_iterations;
+            int batch_end = std::min(num_iterations + batch_size, max_iterations_);
+            std::function<void(int)> score = [&](int t)
+            {
+                if (t < num_threads)
+                {
+                    scoreHypotheses(fit_data, mean, strata, fit_seed, batch_begin + t, batch_end, num_threads, inlier_threshold, workspaces.at(t), num_inliers);
+                }
+            };
+            if (num_threads == 1)
+            {
+                score(0);
+            }
+            else
+            {
+                team_->run(score);
+            }
+            num_iterations = batch_end;
+
+            // ties go to the lowest hypothesis number, whichever thread scored it
+            best_hypothesis = std::max_element(num_inliers.begin(), num_inliers.begin() + num_iterations) - num_inliers.begin();
+            required_iterations = getRequiredIterations(num_inliers.at(best_hypothesis) / static_cast<double>(num_fit_trajectories), num_sample_points, confidence_);
+        }
+        if (print) std::cout << num_iterations << " iterations" << std::endl;
+        max_points = num_inliers.at(best_hypothesis);
+
+        // no hypothesis explaining any trajectory leaves the residual empty, so
+        // nothing is an outlier
+        if (max_points > 0)
+        {
+            // regenerating the winner is cheaper than keeping every residual
+            SubspaceWorkspace &workspace = workspaces.at(0);
+            generateHypothesis(fit_data, mean, strata, fit_seed, best_hypothesis, workspace);
+            final_residual = workspace.residual;
+            final_basis = workspace.basis;
+            final_columns = workspace.column_indices;
+        }
+    }
+
+    if (subsampled && max_points > 0)
+    {
+        // one residual pass over every trajectory
+        SubspaceWorkspace workspace;
+        workspace.resize(data, num_sample_points);
+        computeResiduals(data, mean, final_basis, workspace);
+        final_residual = workspace.residual;
+        for (int i = 0; i < final_columns.size(); i++)
+        {
+            final_columns.at(i) = fit_columns.at(final_columns.at(i));
         }
     }
+
+    if (warm_start_)
+    {
+        previous_inliers_.clear();
+        for (int idx = 0; idx < final_residual.size(); idx++)
+        {
+            if (final_residual(idx) < inlier_threshold)
+            {
+                previous_inliers_.insert(getPointKey(getLastPoint(data, idx)));
+            }
+        }
+    }
+
     if (print) std::cout << "final residual " << std::endl;
     if (print) std::cout << final_residual << std::endl;
     double residual_threshold = 0.2;
     if (subspace_dimensions - num_sample_points < 11 && subspace_dimensions - num_sample_points > 0)
     {
         residual_threshold = sigma * sigma * chi_square_table.at(0).at(subspace_dimensions - num_sample_points);
-        std::cout << "residual threshold: " << residual_threshold << std::endl;
+        if (print) std::cout << "residual threshold: " << residual_threshold << std::endl;
     }
     for (int idx = 0; idx < final_residual.size(); idx++)
     {
         if (final_residual(idx) > residual_threshold)
         {
-            outlier_points.push_back(trajectories.at(idx).at(trajectories.at(idx).size() - 2));
+            outlier_columns.push_back(idx);
         }
     }
-    std::vector<std::vector<cv::Point2f> > trajectory_subspace_vectors;
-    for (int i = 0; i < final_columns.size(); i++)
-    {
-        trajectory_subspace_vectors.push_back(trajectories.at(final_columns.at(i)));
-    }
-    return trajectory_subspace_vectors;
+    subspace_columns = final_columns;
 }
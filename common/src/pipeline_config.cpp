@@ -0,0 +1,45 @@
+/* pipeline_config.cpp
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include <motion_detection/pipeline_config.h>
+
+PipelineConfig::PipelineConfig() :
+    skip_frames(1),
+    num_motions(2),
+    pixel_step(10),
+    min_vector_size(1.0),
+    seed_border(10),
+    merge_tracks(true),
+    distance_threshold(50.0),
+    min_cluster_size(6),
+    angular_threshold(0.15),
+    clustering_method("connected"),
+    density_min_points(4),
+    clustering_threads(0),
+    sigma(0.5),
+    residual_threshold(0.2),
+    ransac_seed(0),
+    ransac_threads(0),
+    ransac_confidence(0.99),
+    ransac_max_iterations(50),
+    subspace_max_trajectories(0),
+    subspace_warm_start(false),
+    warm_start_min_inlier_ratio(0.5),
+    save_frames(false),
+    frames_path("")
+{
+}
+
+int PipelineConfig::getTrajectorySize(bool egomotion) const
+{
+    if (!egomotion)
+    {
+        return 2;
+    }
+    return num_motions * 2 + 1;
+}
@@ -0,0 +1,135 @@
+/* thread_pool.cpp
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include <motion_detection/thread_pool.h>
+
+ThreadPool::ThreadPool(int num_threads) : stopping_(false)
+{
+    if (num_threads <= 0)
+    {
+        num_threads = std::thread::hardware_concurrency();
+    }
+    if (num_threads <= 0)
+    {
+        num_threads = 1;
+    }
+    for (int i = 0; i < num_threads; i++)
+    {
+        workers_.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_available_.notify_all();
+    for (int i = 0; i < workers_.size(); i++)
+    {
+        workers_.at(i).join();
+    }
+}
+
+int ThreadPool::addStrand(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Strand strand;
+    strand.capacity = capacity;
+    strand.running = false;
+    strands_.push_back(strand);
+    return strands_.size() - 1;
+}
+
+bool ThreadPool::post(int strand, const std::function<void()> &task)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Strand &s = strands_.at(strand);
+    if (s.capacity > 0 && s.tasks.size() >= s.capacity)
+    {
+        return false;
+    }
+    s.tasks.push_back(task);
+    if (!s.running && s.tasks.size() == 1)
+    {
+        ready_.push_back(strand);
+        work_available_.notify_one();
+    }
+    return true;
+}
+
+void ThreadPool::waitIdle(int strand)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (strands_.at(strand).running || !strands_.at(strand).tasks.empty())
+    {
+        strand_idle_.wait(lock);
+    }
+}
+
+void ThreadPool::waitIdle(const std::vector<int> &strands)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        bool idle = true;
+        for (int i = 0; i < strands.size() && idle; i++)
+        {
+            const Strand &s = strands_.at(strands.at(i));
+            idle = !s.running && s.tasks.empty();
+        }
+        if (idle)
+        {
+            return;
+        }
+        strand_idle_.wait(lock);
+    }
+}
+
+int ThreadPool::getNumThreads() const
+{
+    return workers_.size();
+}
+
+void ThreadPool::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        while (!stopping_ && ready_.empty())
+        {
+            work_available_.wait(lock);
+        }
+        if (ready_.empty())
+        {
+            return;
+        }
+        int strand = ready_.front();
+        ready_.pop_front();
+        std::function<void()> task = strands_.at(strand).tasks.front();
+        strands_.at(strand).tasks.pop_front();
+        strands_.at(strand).running = true;
+
+        lock.unlock();
+        task();
+        lock.lock();
+
+        // back of the line, so every busy strand gets its turn
+        strands_.at(strand).running = false;
+        if (!strands_.at(strand).tasks.empty())
+        {
+            ready_.push_back(strand);
+            work_available_.notify_one();
+        }
+        else
+        {
+            strand_idle_.notify_all();
+        }
+    }
+}
@@ -0,0 +1,143 @@
+/* track_store.cpp
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include <motion_detection/track_store.h>
+#include <algorithm>
+
+TrackStore::TrackStore() : window_size_(0), num_tracks_(0)
+{
+}
+
+TrackStore::~TrackStore()
+{
+}
+
+void TrackStore::reset(int window_size)
+{
+    window_size_ = window_size;
+    num_tracks_ = 0;
+    points_.clear();
+    lengths_.clear();
+}
+
+int TrackStore::size() const
+{
+    return num_tracks_;
+}
+
+int TrackStore::getWindowSize() const
+{
+    return window_size_;
+}
+
+int TrackStore::getLength(int track) const
+{
+    return lengths_.at(track);
+}
+
+bool TrackStore::isComplete(int track) const
+{
+    return lengths_.at(track) == window_size_;
+}
+
+cv::Point2f TrackStore::getPoint(int track, int index) const
+{
+    const float *column = &points_.at(track * 2 * window_size_);
+    return cv::Point2f(column[index * 2], column[index * 2 + 1]);
+}
+
+cv::Point2f TrackStore::getLastPoint(int track) const
+{
+    return getPoint(track, lengths_.at(track) - 1);
+}
+
+void TrackStore::addTrack(const cv::Point2f &point)
+{
+    // the buffer only grows, truncate keeps its capacity
+    if (points_.size() < (num_tracks_ + 1) * 2 * window_size_)
+    {
+        points_.resize((num_tracks_ + 1) * 2 * window_size_);
+        lengths_.resize(num_tracks_ + 1);
+    }
+    float *column = &points_.at(num_tracks_ * 2 * window_size_);
+    column[0] = point.x;
+    column[1] = point.y;
+    lengths_.at(num_tracks_) = 1;
+    num_tracks_++;
+}
+
+void TrackStore::extendTrack(int track, const cv::Point2f &point)
+{
+    float *column = &points_.at(track * 2 * window_size_);
+    int &length = lengths_.at(track);
+    if (length == window_size_)
+    {
+        std::copy(column + 2, column + 2 * window_size_, column);
+        length--;
+    }
+    column[length * 2] = point.x;
+    column[length * 2 + 1] = point.y;
+    length++;
+}
+
+void TrackStore::moveTrack(int from, int to)
+{
+    if (from == to)
+    {
+        return;
+    }
+    std::vector<float>::const_iterator column = points_.begin() + from * 2 * window_size_;
+    std::copy(column, column + 2 * lengths_.at(from), points_.begin() + to * 2 * window_size_);
+    lengths_.at(to) = lengths_.at(from);
+}
+
+void TrackStore::truncate(int num_tracks)
+{
+    num_tracks_ = std::min(num_tracks_, num_tracks);
+}
+
+int TrackStore::getNumCompleteTracks() const
+{
+    int num_complete = 0;
+    while (num_complete < num_tracks_ && lengths_.at(num_complete) == window_size_)
+    {
+        num_complete++;
+    }
+    return num_complete;
+}
+
+const float *TrackStore::getData() const
+{
+    return points_.empty() ? NULL : &points_.at(0);
+}
+
+void TrackStore::copyCompleteTracks(TrackStore &tracks) const
+{
+    int num_complete = getNumCompleteTracks();
+    tracks.window_size_ = window_size_;
+    tracks.num_tracks_ = num_complete;
+    tracks.points_.assign(points_.begin(), points_.begin() + num_complete * 2 * window_size_);
+    tracks.lengths_.assign(num_complete, window_size_);
+}
+
+void TrackStore::getTrajectories(std::vector<std::vector<cv::Point2f> > &trajectories) const
+{
+    for (int i = 0; i < num_tracks_; i++)
+    {
+        if (!isComplete(i))
+        {
+            continue;
+        }
+        std::vector<cv::Point2f> trajectory(window_size_);
+        for (int j = 0; j < window_size_; j++)
+        {
+            trajectory.at(j) = getPoint(i, j);
+        }
+        trajectories.push_back(trajectory);
+    }
+}
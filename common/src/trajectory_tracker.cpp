@@ -0,0 +1,204 @@
+/* trajectory_tracker.cpp
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include <motion_detection/trajectory_tracker.h>
+#include <motion_detection/frame_cache.h>
+#include <opencv2/video/tracking.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+
+namespace
+{
+    // tracks that get closer to the border than this are dropped
+    const int BORDER = 10;
+}
+
+TrajectoryTracker::TrajectoryTracker() : trajectory_size_(0), pixel_step_(0), min_vector_size_(0.0), seed_border_(BORDER), merge_tracks_(true), num_frames_(0)
+{
+}
+
+TrajectoryTracker::~TrajectoryTracker()
+{
+}
+
+void TrajectoryTracker::setParameters(int trajectory_size, int pixel_step, double min_vector_size)
+{
+    if (trajectory_size != trajectory_size_ || pixel_step != pixel_step_ || min_vector_size != min_vector_size_)
+    {
+        trajectory_size_ = trajectory_size;
+        pixel_step_ = pixel_step;
+        min_vector_size_ = min_vector_size;
+        reset();
+    }
+}
+
+void TrajectoryTracker::setSeeding(int seed_border, bool merge_tracks)
+{
+    if (seed_border != seed_border_ || merge_tracks != merge_tracks_)
+    {
+        seed_border_ = seed_border;
+        merge_tracks_ = merge_tracks;
+        reset();
+    }
+}
+
+void TrajectoryTracker::reset()
+{
+    num_frames_ = 0;
+    image_size_ = cv::Size();
+    previous_pyramid_.clear();
+    previous_points_.clear();
+    tracks_.reset(std::max(trajectory_size_, 1));
+}
+
+int TrajectoryTracker::addFrame(const cv::Mat &image, FlowField &optical_flow_vectors)
+{
+    cv::Mat gray_image;
+    if (image.channels() == 3)
+    {
+        cvtColor(image, gray_image, CV_BGR2GRAY);
+    }
+    else
+    {
+        gray_image = image;
+    }
+
+    std::vector<cv::Mat> pyramid;
+    cv::buildOpticalFlowPyramid(gray_image, pyramid, FrameCache::windowSize(), FrameCache::maxLevel(), true);
+    return addFrame(pyramid, optical_flow_vectors);
+}
+
+int TrajectoryTracker::addFrame(const std::vector<cv::Mat> &pyramid, FlowField &optical_flow_vectors)
+{
+    cv::TermCriteria termcrit(CV_TERMCRIT_ITER | CV_TERMCRIT_EPS, 10, 0.03);
+
+    if (pyramid.at(0).size() != image_size_)
+    {
+        reset();
+        image_size_ = pyramid.at(0).size();
+    }
+
+    optical_flow_vectors.reset(image_size_, pixel_step_);
+
+    int num_vectors = 0;
+    if (!previous_points_.empty())
+    {
+        cv::calcOpticalFlowPyrLK(previous_pyramid_, pyramid, previous_points_, next_points_, status_, err_, FrameCache::windowSize(), FrameCache::maxLevel(), termcrit, 0, 0.001);
+
+        // advance surviving tracks and compact them to the front, keeping their order
+        int num_alive = 0;
+        for (int i = 0; i < previous_points_.size(); i++)
+        {
+            cv::Point2f start_point = previous_points_.at(i);
+            cv::Point2f end_point = next_points_.at(i);
+            // unless tracks are merged, a later track in the same cell
+            // overwrites the vector of an earlier one
+            int index = optical_flow_vectors.getIndex(start_point);
+            if (!status_[i])
+            {
+                if (index != -1)
+                {
+                    optical_flow_vectors.setLost(index);
+                }
+                continue;
+            }
+            float x_diff = end_point.x - start_point.x;
+            float y_diff = end_point.y - start_point.y;
+            if (std::abs(x_diff) > min_vector_size_ || std::abs(y_diff) > min_vector_size_)
+            {
+                num_vectors++;
+            }
+            else
+            {
+                x_diff = 0.0f;
+                y_diff = 0.0f;
+            }
+            if (index != -1)
+            {
+                optical_flow_vectors.setVector(index, start_point, cv::Point2f(x_diff, y_diff));
+            }
+            if (isInsideBorder(end_point, BORDER))
+            {
+                tracks_.moveTrack(i, num_alive);
+                tracks_.extendTrack(num_alive, end_point);
+                previous_points_.at(num_alive) = end_point;
+                num_alive++;
+            }
+        }
+        tracks_.truncate(num_alive);
+        previous_points_.resize(num_alive);
+    }
+    previous_pyramid_ = pyramid;
+    seedTracks();
+    num_frames_++;
+    return num_vectors;
+}
+
+void TrajectoryTracker::getTrajectories(std::vector<std::vector<cv::Point2f> > &trajectories) const
+{
+    tracks_.getTrajectories(trajectories);
+}
+
+void TrajectoryTracker::getTracks(TrackStore &tracks) const
+{
+    tracks_.copyCompleteTracks(tracks);
+}
+
+bool TrajectoryTracker::isWindowFull() const
+{
+    return num_frames_ >= trajectory_size_;
+}
+
+bool TrajectoryTracker::isInsideBorder(const cv::Point2f &point, int border) const
+{
+    return point.x > border && point.y > border && point.x < image_size_.width - border && point.y < image_size_.height - border;
+}
+
+void TrajectoryTracker::seedTracks()
+{
+    int grid_cols = image_size_.width / pixel_step_ + 2;
+    int grid_rows = image_size_.height / pixel_step_ + 2;
+    cell_owner_.assign(grid_cols * grid_rows, -1);
+
+    // tracks are ordered from oldest to youngest, so the oldest track in a
+    // cell keeps it and, when merging, tracks that converged onto it are dropped
+    int num_kept = 0;
+    for (int i = 0; i < previous_points_.size(); i++)
+    {
+        cv::Point2f point = previous_points_.at(i);
+        int cell_x = cvRound(point.x / pixel_step_);
+        int cell_y = cvRound(point.y / pixel_step_);
+        int cell = cell_y * grid_cols + cell_x;
+        if (cell_owner_.at(cell) != -1 && merge_tracks_)
+        {
+            continue;
+        }
+        if (cell_owner_.at(cell) == -1)
+        {
+            cell_owner_.at(cell) = num_kept;
+        }
+        tracks_.moveTrack(i, num_kept);
+        previous_points_.at(num_kept) = point;
+        num_kept++;
+    }
+    tracks_.truncate(num_kept);
+    previous_points_.resize(num_kept);
+
+    for (int i = 0; i < image_size_.width; i = i + pixel_step_)
+    {
+        for (int j = 0; j < image_size_.height; j = j + pixel_step_)
+        {
+            cv::Point2f point(i, j);
+            if (cell_owner_.at((j / pixel_step_) * grid_cols + (i / pixel_step_)) == -1 && (seed_border_ == 0 || isInsideBorder(point, seed_border_)))
+            {
+                previous_points_.push_back(point);
+                tracks_.addTrack(point);
+            }
+        }
+    }
+}
@@ -0,0 +1,128 @@
+/* union_find.cpp
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include <motion_detection/union_find.h>
+#include <algorithm>
+
+UnionFind::UnionFind()
+{
+}
+
+UnionFind::~UnionFind()
+{
+}
+
+void UnionFind::reset(int num_elements)
+{
+    parents_.resize(num_elements);
+    for (int i = 0; i < num_elements; i++)
+    {
+        parents_[i] = i;
+    }
+    sizes_.assign(num_elements, 1);
+}
+
+int UnionFind::size() const
+{
+    return parents_.size();
+}
+
+int UnionFind::find(int element)
+{
+    while (parents_[element] != element)
+    {
+        parents_[element] = parents_[parents_[element]];
+        element = parents_[element];
+    }
+    return element;
+}
+
+void UnionFind::unite(int a, int b)
+{
+    a = find(a);
+    b = find(b);
+    if (a == b)
+    {
+        return;
+    }
+    if (sizes_[a] < sizes_[b])
+    {
+        std::swap(a, b);
+    }
+    parents_[b] = a;
+    sizes_[a] += sizes_[b];
+}
+
+AtomicUnionFind::AtomicUnionFind()
+{
+}
+
+AtomicUnionFind::~AtomicUnionFind()
+{
+}
+
+void AtomicUnionFind::reset(int num_elements)
+{
+    if (parents_.size() != num_elements)
+    {
+        std::vector<std::atomic<int> > parents(num_elements);
+        parents_.swap(parents);
+    }
+    for (int i = 0; i < num_elements; i++)
+    {
+        parents_[i].store(i);
+    }
+}
+
+int AtomicUnionFind::size() const
+{
+    return parents_.size();
+}
+
+int AtomicUnionFind::find(int element)
+{
+    while (true)
+    {
+        int parent = parents_[element].load();
+        if (parent == element)
+        {
+            return element;
+        }
+        // path halving; a parent only ever moves closer to the root, so a
+        // failed exchange can be ignored
+        int grandparent = parents_[parent].load();
+        if (grandparent != parent)
+        {
+            parents_[element].compare_exchange_weak(parent, grandparent);
+        }
+        element = grandparent;
+    }
+}
+
+void AtomicUnionFind::unite(int a, int b)
+{
+    while (true)
+    {
+        a = find(a);
+        b = find(b);
+        if (a == b)
+        {
+            return;
+        }
+        if (a < b)
+        {
+            std::swap(a, b);
+        }
+        // a may have been linked by another thread in the meantime
+        int expected = a;
+        if (parents_[a].compare_exchange_strong(expected, b))
+        {
+            return;
+        }
+    }
+}
@@ -8,8 +8,11 @@
 
 #include <motion_detection/vector_cluster.h>
 #include <iostream>
+#include <cmath>
 
-VectorCluster::VectorCluster()
+VectorCluster::VectorCluster() : x_sum_(0.0), y_sum_(0.0), direction_x_sum_(0.0), direction_y_sum_(0.0),
+                                 min_x_(std::numeric_limits<double>::max()), max_x_(-1.0),
+                                 min_y_(std::numeric_limits<double>::max()), max_y_(-1.0)
 {
 }
 
@@ -20,78 +23,90 @@ VectorCluster::~VectorCluster()
 void VectorCluster::addVector(const cv::Vec4d & vector)
 {
     cluster_.push_back(vector);
+    cluster_points_.push_back(cv::Point2f(vector[0], vector[1]));
+    cv::Point2d direction = getDirection(vector);
+    directions_.push_back(direction);
+
+    x_sum_ += vector[0];
+    y_sum_ += vector[1];
+    direction_x_sum_ += direction.x;
+    direction_y_sum_ += direction.y;
+    if (vector[0] < min_x_) min_x_ = vector[0];
+    if (vector[1] < min_y_) min_y_ = vector[1];
+    if (vector[0] > max_x_) max_x_ = vector[0];
+    if (vector[1] > max_y_) max_y_ = vector[1];
 }
 
-double VectorCluster::getClosestDistance(const cv::Vec4d &vector)
+double VectorCluster::getClosestDistance(const cv::Vec4d &vector) const
 {
-    double min_distance = std::numeric_limits<double>::max();
+    double min_squared_distance = std::numeric_limits<double>::max();
     for (int i = 0; i < cluster_.size(); i++)
     {
-        double distance = getDistance(vector, cluster_.at(i));
-        if (distance < min_distance)
+        double x_diff = vector[0] - cluster_[i][0];
+        double y_diff = vector[1] - cluster_[i][1];
+        double squared_distance = x_diff * x_diff + y_diff * y_diff;
+        if (squared_distance < min_squared_distance)
         {
-            min_distance = distance;
+            min_squared_distance = squared_distance;
         }
     }
-    return min_distance;
+    if (cluster_.empty())
+    {
+        return min_squared_distance;
+    }
+    return std::sqrt(min_squared_distance);
 }
-double VectorCluster::getClosestOrientation(const cv::Vec4d &vector)
+
+double VectorCluster::getClosestOrientation(const cv::Vec4d &vector) const
 {
-    double min_angular_distance = std::numeric_limits<double>::max();
-    for (int i = 0; i < cluster_.size(); i++)
+    if (directions_.empty())
+    {
+        return std::numeric_limits<double>::max();
+    }
+    // the closest orientation has the largest dot product
+    cv::Point2d direction = getDirection(vector);
+    int closest = 0;
+    double max_dot = -2.0;
+    for (int i = 0; i < directions_.size(); i++)
     {
-        double angular_distance = abs(getAngularDistance(vector, cluster_.at(i)));
-        if (angular_distance < min_angular_distance)
+        double dot = direction.dot(directions_[i]);
+        if (dot > max_dot)
         {
-            min_angular_distance = angular_distance;
+            max_dot = dot;
+            closest = i;
         }
     }
-    return min_angular_distance;
+    double cross = direction.cross(directions_[closest]);
+    return std::atan2(std::fabs(cross), max_dot);
 }
 
-cv::Point2f VectorCluster::getCentroid()
+cv::Point2f VectorCluster::getCentroid() const
 {
-    double x_sum = 0.0;
-    double y_sum = 0.0;
-    for (int i = 0; i < cluster_.size(); i++)
-    {
-        x_sum += cluster_.at(i)[0];
-        y_sum += cluster_.at(i)[1];
-    }
-    x_sum /= cluster_.size();
-    y_sum /= cluster_.size();
-    cv::Point2f centroid(x_sum, y_sum);
+    cv::Point2f centroid(x_sum_ / cluster_.size(), y_sum_ / cluster_.size());
     return centroid;
 }
 
-double VectorCluster::getMeanOrientation()
+double VectorCluster::getMeanOrientation() const
 {
-    double angle_sum = 0.0;
-    for (int i = 0; i < cluster_.size(); i++)
+    double angle = std::atan2(direction_y_sum_, direction_x_sum_);
+    if (angle < 0.0)
     {
-        angle_sum += getAngle(cluster_.at(i));
+        angle += 2 * M_PI;
     }
-    angle_sum /= cluster_.size();
-    return angle_sum;
+    return angle;
 }
 
-std::vector<cv::Vec4d> VectorCluster::getCluster()
+const std::vector<cv::Vec4d> &VectorCluster::getCluster() const
 {
     return cluster_;
 }
 
-std::vector<cv::Point2f> VectorCluster::getClusterPoints()
+const std::vector<cv::Point2f> &VectorCluster::getClusterPoints() const
 {
-    std::vector<cv::Point2f> cluster_points;
-    for (int i = 0; i < cluster_.size(); i++)
-    {
-        cv::Point2f p(cluster_.at(i)[0], cluster_.at(i)[1]);
-        cluster_points.push_back(p);
-    }
-    return cluster_points;
+    return cluster_points_;
 }
 
-std::vector<cv::Vec4d> VectorCluster::getMeanVector()
+std::vector<cv::Vec4d> VectorCluster::getMeanVector() const
 {
     cv::Point2f centroid = getCentroid();
     double orientation = getMeanOrientation();
@@ -111,46 +126,25 @@ std::vector<cv::Vec4d> VectorCluster::getMeanVector()
 
 }
 
-int VectorCluster::size()
+int VectorCluster::size() const
 {
     return cluster_.size();
 }
-double VectorCluster::getDistance(const cv::Vec4d &one, const cv::Vec4d &two)
-{
-    return sqrt((one[0] - two[0])*(one[0] - two[0]) + (one[1] - two[1]) * (one[1] - two[1]));
-}
 
-double VectorCluster::getAngularDistance(const cv::Vec4d &one, const cv::Vec4d &two)
+cv::Point2d VectorCluster::getDirection(const cv::Vec4d &vector) const
 {
-
-    double angle1 = getAngle(one);
-    double angle2 = getAngle(two);
-    return atan2(sin(angle1 - angle2), cos(angle1 - angle2));    
-}
-
-double VectorCluster::getAngle(const cv::Vec4d &vector)
-{
-    double ang = atan2(vector[3], vector[2]);
-    if (ang < 0.0)
+    double norm = std::sqrt(vector[2] * vector[2] + vector[3] * vector[3]);
+    if (norm == 0.0)
     {
-        ang += 2 * M_PI;
+        return cv::Point2d(1.0, 0.0);
     }
-    return ang;
+    return cv::Point2d(vector[2] / norm, vector[3] / norm);
 }
 
-void VectorCluster::getMinMax(double &min_x, double &max_x, double &min_y, double &max_y)
+void VectorCluster::getMinMax(double &min_x, double &max_x, double &min_y, double &max_y) const
 {
-    min_x = std::numeric_limits<double>::max();
-    max_x = -1.0;
-    min_y = std::numeric_limits<double>::max();
-    max_y = -1.0;
-    for (int i = 0; i < cluster_.size(); i++)
-    {
-        double x = cluster_.at(i)[0];
-        double y = cluster_.at(i)[1];
-        if (x < min_x) min_x = x;
-        if (y < min_y) min_y = y;
-        if (x > max_x) max_x = x;
-        if (y > max_y) max_y = y;
-    }
+    min_x = min_x_;
+    max_x = max_x_;
+    min_y = min_y_;
+    max_y = max_y_;
 }
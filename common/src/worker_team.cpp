@@ -0,0 +1,82 @@
+/* worker_team.cpp
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include <motion_detection/worker_team.h>
+
+WorkerTeam::WorkerTeam(int num_threads) : task_(NULL), round_(0), num_running_(0), stopping_(false)
+{
+    for (int member = 1; member < num_threads; member++)
+    {
+        workers_.push_back(std::thread(&WorkerTeam::workerLoop, this, member));
+    }
+}
+
+WorkerTeam::~WorkerTeam()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    round_started_.notify_all();
+    for (int i = 0; i < workers_.size(); i++)
+    {
+        workers_.at(i).join();
+    }
+}
+
+int WorkerTeam::size() const
+{
+    return workers_.size() + 1;
+}
+
+void WorkerTeam::run(const std::function<void(int)> &task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        num_running_ = workers_.size();
+        round_++;
+    }
+    round_started_.notify_all();
+    task(0);
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (num_running_ > 0)
+    {
+        round_finished_.wait(lock);
+    }
+    task_ = NULL;
+}
+
+void WorkerTeam::workerLoop(int member)
+{
+    unsigned long last_round = 0;
+    while (true)
+    {
+        const std::function<void(int)> *task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!stopping_ && round_ == last_round)
+            {
+                round_started_.wait(lock);
+            }
+            if (stopping_)
+            {
+                return;
+            }
+            last_round = round_;
+            task = task_;
+        }
+        (*task)(member);
+        std::lock_guard<std::mutex> lock(mutex_);
+        num_running_--;
+        if (num_running_ == 0)
+        {
+            round_finished_.notify_one();
+        }
+    }
+}
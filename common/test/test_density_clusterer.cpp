@@ -0,0 +1,279 @@
+/* test_density_clusterer.cpp
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include <motion_detection/density_clusterer.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+/**
+ * Blobs of points around a few centres plus uniform noise. Directions, if
+ * requested, are similar within the first blobs and random elsewhere.
+ */
+std::vector<cv::Point2f> getPoints(int num_points, unsigned int seed, std::vector<cv::Point2f> *directions)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> spread(0.0f, 12.0f);
+    std::uniform_real_distribution<float> uniform(0.0f, 640.0f);
+    std::uniform_real_distribution<float> angle(0.0f, 2.0f * CV_PI);
+    cv::Point2f centres[] = {cv::Point2f(80, 80), cv::Point2f(300, 100), cv::Point2f(200, 300), cv::Point2f(500, 400), cv::Point2f(520, 90)};
+    std::vector<cv::Point2f> points;
+    for (int i = 0; i < num_points; i++)
+    {
+        if (i % 4 == 3)
+        {
+            points.push_back(cv::Point2f(uniform(rng), uniform(rng) * 0.75f));
+        }
+        else
+        {
+            points.push_back(centres[i % 5] + cv::Point2f(spread(rng), spread(rng)));
+        }
+        if (directions)
+        {
+            float a = (i % 5 < 3) ? 0.3f + 0.01f * spread(rng) : angle(rng);
+            directions->push_back(cv::Point2f(std::cos(a), std::sin(a)));
+        }
+    }
+    return points;
+}
+
+/**
+ * Numbers the clusters in the order of their first point.
+ */
+std::vector<int> renumber(const std::vector<int> &labels)
+{
+    std::map<int, int> numbers;
+    std::vector<int> renumbered(labels.size(), -1);
+    for (int i = 0; i < labels.size(); i++)
+    {
+        if (labels[i] == -1)
+        {
+            continue;
+        }
+        if (numbers.count(labels[i]) == 0)
+        {
+            int number = numbers.size();
+            numbers[labels[i]] = number;
+        }
+        renumbered[i] = numbers[labels[i]];
+    }
+    return renumbered;
+}
+
+/**
+ * DBSCAN by comparing all pairs; border points go to the closest core
+ * neighbour, ties to the one that comes first by position and direction.
+ */
+std::vector<int> clusterBruteForce(const std::vector<cv::Point2f> &points, const std::vector<cv::Point2f> &directions,
+                                   double distance_threshold, double min_cosine, int min_points)
+{
+    int num_points = points.size();
+    std::vector<std::vector<int> > neighbours(num_points);
+    for (int i = 0; i < num_points; i++)
+    {
+        for (int j = 0; j < num_points; j++)
+        {
+            double x_diff = points[i].x - points[j].x;
+            double y_diff = points[i].y - points[j].y;
+            if (x_diff * x_diff + y_diff * y_diff < distance_threshold * distance_threshold &&
+                (directions.empty() || directions[i].x * directions[j].x + directions[i].y * directions[j].y > min_cosine))
+            {
+                neighbours[i].push_back(j);
+            }
+        }
+    }
+    std::vector<int> components(num_points, -1);
+    int num_components = 0;
+    for (int i = 0; i < num_points; i++)
+    {
+        if (neighbours[i].size() < min_points || components[i] != -1)
+        {
+            continue;
+        }
+        std::vector<int> stack(1, i);
+        components[i] = num_components;
+        while (!stack.empty())
+        {
+            int k = stack.back();
+            stack.pop_back();
+            for (int n = 0; n < neighbours[k].size(); n++)
+            {
+                int j = neighbours[k][n];
+                if (neighbours[j].size() >= min_points && components[j] == -1)
+                {
+                    components[j] = num_components;
+                    stack.push_back(j);
+                }
+            }
+        }
+        num_components++;
+    }
+    std::vector<int> labels(num_points, -1);
+    for (int i = 0; i < num_points; i++)
+    {
+        if (components[i] != -1)
+        {
+            labels[i] = components[i];
+            continue;
+        }
+        int closest = -1;
+        double closest_distance = 0.0;
+        for (int n = 0; n < neighbours[i].size(); n++)
+        {
+            int j = neighbours[i][n];
+            if (components[j] == -1)
+            {
+                continue;
+            }
+            double x_diff = points[i].x - points[j].x;
+            double y_diff = points[i].y - points[j].y;
+            double distance = x_diff * x_diff + y_diff * y_diff;
+            bool before = closest != -1 && distance == closest_distance &&
+                          (points[j].y != points[closest].y ? points[j].y < points[closest].y :
+                           points[j].x != points[closest].x ? points[j].x < points[closest].x :
+                           !directions.empty() && (directions[j].y != directions[closest].y ? directions[j].y < directions[closest].y :
+                                                   directions[j].x < directions[closest].x));
+            if (closest == -1 || distance < closest_distance || before)
+            {
+                closest = j;
+                closest_distance = distance;
+            }
+        }
+        if (closest != -1)
+        {
+            labels[i] = components[closest];
+        }
+    }
+    return renumber(labels);
+}
+
+}
+
+TEST(DensityClusterer, MatchesBruteForce)
+{
+    for (int t = 0; t < 8; t++)
+    {
+        std::vector<cv::Point2f> directions;
+        bool use_directions = (t % 2 == 1);
+        std::vector<cv::Point2f> points = getPoints(300 + 150 * t, t, use_directions ? &directions : NULL);
+        double distance_threshold = 3.0 + 1.5 * t;
+        int min_points = 2 + t % 5;
+        std::vector<int> expected = clusterBruteForce(points, directions, distance_threshold, std::cos(0.3), min_points);
+
+        DensityClusterer clusterer;
+        std::vector<int> labels;
+        int num_clusters = clusterer.cluster(points, directions, distance_threshold, std::cos(0.3), min_points, labels);
+        EXPECT_EQ(expected, labels) << "case " << t;
+        EXPECT_EQ(*std::max_element(expected.begin(), expected.end()) + 1, num_clusters) << "case " << t;
+    }
+}
+
+TEST(DensityClusterer, SameLabelsForAnyNumberOfThreads)
+{
+    // enough points for several threads
+    std::vector<cv::Point2f> directions;
+    std::vector<cv::Point2f> points = getPoints(20000, 3, &directions);
+    std::vector<cv::Point2f> no_directions;
+
+    DensityClusterer serial;
+    serial.setNumThreads(1);
+    std::vector<int> expected;
+    std::vector<int> expected_without_directions;
+    serial.cluster(points, directions, 8.0, std::cos(0.3), 4, expected);
+    serial.cluster(points, no_directions, 8.0, -2.0, 4, expected_without_directions);
+
+    int thread_counts[] = {2, 4, 8};
+    for (int c = 0; c < 3; c++)
+    {
+        DensityClusterer clusterer;
+        clusterer.setNumThreads(thread_counts[c]);
+        std::vector<int> labels;
+        clusterer.cluster(points, directions, 8.0, std::cos(0.3), 4, labels);
+        EXPECT_EQ(expected, labels) << thread_counts[c] << " threads";
+        clusterer.cluster(points, no_directions, 8.0, -2.0, 4, labels);
+        EXPECT_EQ(expected_without_directions, labels) << thread_counts[c] << " threads";
+    }
+}
+
+TEST(DensityClusterer, SamePartitionForAnyOrder)
+{
+    // points on a coarse lattice, so that many border points are equally
+    // close to several core points
+    std::mt19937 rng(5);
+    for (int t = 0; t < 4; t++)
+    {
+        std::vector<cv::Point2f> directions;
+        bool use_directions = (t % 2 == 1);
+        std::vector<cv::Point2f> points = getPoints(1000 + 500 * t, 10 + t, use_directions ? &directions : NULL);
+        for (int i = 0; i < points.size(); i++)
+        {
+            points[i] = cv::Point2f(2.0f * cvRound(points[i].x / 2.0f), 2.0f * cvRound(points[i].y / 2.0f));
+        }
+        for (int i = 0; i < directions.size(); i++)
+        {
+            directions[i] = cv::Point2f(cvRound(4.0f * directions[i].x) / 4.0f, cvRound(4.0f * directions[i].y) / 4.0f);
+        }
+        double distance_threshold = 4.5 + t;
+        int min_points = 3 + t;
+
+        DensityClusterer clusterer;
+        std::vector<int> expected;
+        clusterer.cluster(points, directions, distance_threshold, 0.5, min_points, expected);
+
+        std::vector<int> order(points.size());
+        for (int i = 0; i < order.size(); i++)
+        {
+            order[i] = i;
+        }
+        std::shuffle(order.begin(), order.end(), rng);
+        std::vector<cv::Point2f> shuffled_points;
+        std::vector<cv::Point2f> shuffled_directions;
+        for (int i = 0; i < order.size(); i++)
+        {
+            shuffled_points.push_back(points[order[i]]);
+            if (use_directions)
+            {
+                shuffled_directions.push_back(directions[order[i]]);
+            }
+        }
+        std::vector<int> shuffled_labels;
+        clusterer.cluster(shuffled_points, shuffled_directions, distance_threshold, 0.5, min_points, shuffled_labels);
+        std::vector<int> labels(points.size());
+        for (int i = 0; i < order.size(); i++)
+        {
+            labels[order[i]] = shuffled_labels[i];
+        }
+        EXPECT_EQ(expected, renumber(labels)) << "case " << t;
+    }
+}
+
+TEST(DensityClusterer, ReusesThreadsAcrossCalls)
+{
+    // one clusterer, called with sets that need more and fewer threads
+    DensityClusterer clusterer;
+    clusterer.setNumThreads(8);
+    int sizes[] = {6000, 20000, 500, 9000};
+    for (int s = 0; s < 4; s++)
+    {
+        std::vector<cv::Point2f> no_directions;
+        std::vector<cv::Point2f> points = getPoints(sizes[s], 20 + s, NULL);
+        DensityClusterer serial;
+        serial.setNumThreads(1);
+        std::vector<int> expected;
+        serial.cluster(points, no_directions, 8.0, -2.0, 4, expected);
+        std::vector<int> labels;
+        clusterer.cluster(points, no_directions, 8.0, -2.0, 4, labels);
+        EXPECT_EQ(expected, labels) << sizes[s] << " points";
+    }
+}
@@ -0,0 +1,343 @@
+/* test_flow_clusterer.cpp
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include <motion_detection/flow_clusterer.h>
+#include <motion_detection/flow_field.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+/**
+ * Connected components of the graph with an edge between every pair for
+ * which connected(i, j) holds, in the order of their first element.
+ */
+template <typename Connected>
+std::vector<std::vector<int> > getComponentsBruteForce(int num_elements, const Connected &connected)
+{
+    std::vector<int> components(num_elements, -1);
+    std::vector<std::vector<int> > members;
+    for (int i = 0; i < num_elements; i++)
+    {
+        if (components[i] != -1)
+        {
+            continue;
+        }
+        components[i] = members.size();
+        std::vector<int> stack(1, i);
+        while (!stack.empty())
+        {
+            int k = stack.back();
+            stack.pop_back();
+            for (int j = 0; j < num_elements; j++)
+            {
+                if (components[j] == -1 && connected(k, j))
+                {
+                    components[j] = members.size();
+                    stack.push_back(j);
+                }
+            }
+        }
+        members.push_back(std::vector<int>());
+    }
+    for (int i = 0; i < num_elements; i++)
+    {
+        members[components[i]].push_back(i);
+    }
+    return members;
+}
+
+std::vector<cv::Point2f> getPoints(int num_points, unsigned int seed)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> spread(0.0f, 15.0f);
+    std::uniform_real_distribution<float> uniform(0.0f, 640.0f);
+    cv::Point2f centres[] = {cv::Point2f(60, 60), cv::Point2f(250, 80), cv::Point2f(160, 200), cv::Point2f(500, 400)};
+    std::vector<cv::Point2f> points;
+    for (int i = 0; i < num_points; i++)
+    {
+        if (i % 5 == 4)
+        {
+            points.push_back(cv::Point2f(uniform(rng), uniform(rng) * 0.75f));
+        }
+        else
+        {
+            points.push_back(centres[i % 4] + cv::Point2f(spread(rng), spread(rng)));
+        }
+    }
+    return points;
+}
+
+struct PointsConnected
+{
+    const std::vector<cv::Point2f> &points;
+    double distance_threshold;
+
+    bool operator()(int i, int j) const
+    {
+        double x_diff = points[i].x - points[j].x;
+        double y_diff = points[i].y - points[j].y;
+        return x_diff * x_diff + y_diff * y_diff < distance_threshold * distance_threshold;
+    }
+};
+
+cv::Point2f getDirection(const cv::Vec4d &vector)
+{
+    float dx = vector[2];
+    float dy = vector[3];
+    float norm = std::sqrt(dx * dx + dy * dy);
+    return cv::Point2f(dx / norm, dy / norm);
+}
+
+struct VectorsConnected
+{
+    const std::vector<cv::Vec4d> &vectors;
+    double distance_threshold;
+    double min_cosine;
+
+    bool operator()(int i, int j) const
+    {
+        // same float arithmetic as the flow field
+        double x_diff = (float)vectors[i][0] - (float)vectors[j][0];
+        double y_diff = (float)vectors[i][1] - (float)vectors[j][1];
+        return x_diff * x_diff + y_diff * y_diff < distance_threshold * distance_threshold &&
+               getDirection(vectors[i]).dot(getDirection(vectors[j])) > min_cosine;
+    }
+};
+
+/**
+ * Flow field with a blob of moving vectors around each of the centres, with
+ * start points within a pixel of the centre. Every other cell is still,
+ * lost or never set.
+ */
+FlowField getBlobs(const std::vector<cv::Point2f> &centres)
+{
+    FlowField flow;
+    flow.reset(cv::Size(640, 480), 4);
+    for (int i = 0; i < flow.size(); i++)
+    {
+        if (i % 3 == 0)
+        {
+            flow.setVector(i, flow.getPixel(i), cv::Point2f(0.0f, 0.0f));
+        }
+        else if (i % 3 == 1)
+        {
+            flow.setLost(i);
+        }
+    }
+    for (int c = 0; c < centres.size(); c++)
+    {
+        int centre = flow.getIndex(centres[c]);
+        for (int row = -1; row <= 1; row++)
+        {
+            for (int col = -1; col <= 1; col++)
+            {
+                int i = centre + row * flow.cols() + col;
+                flow.setVector(i, centres[c] + cv::Point2f(0.5f * col, 0.5f * row), cv::Point2f(2.0f, 1.0f));
+            }
+        }
+    }
+    return flow;
+}
+
+std::vector<cv::Point2f> getBlobCentres()
+{
+    std::vector<cv::Point2f> centres;
+    for (int c = 0; c < 10; c++)
+    {
+        centres.push_back(cv::Point2f(40.0f + 60.0f * c, 100.0f + 30.0f * (c % 3)));
+    }
+    return centres;
+}
+
+// index of the centre row within distance of point, -1 if there is none
+int findCenter(const cv::Mat &centers, const cv::Point2f &point, double distance)
+{
+    for (int c = 0; c < centers.rows; c++)
+    {
+        cv::Point2f diff = cv::Point2f(centers.at<float>(c, 0), centers.at<float>(c, 1)) - point;
+        if (diff.dot(diff) < distance * distance)
+        {
+            return c;
+        }
+    }
+    return -1;
+}
+
+}
+
+TEST(FlowClusterer, ClusterEuclideanMatchesConnectedComponents)
+{
+    int sizes[] = {50, 500, 3000};
+    double thresholds[] = {20.0, 7.5, 3.0};
+    for (int s = 0; s < 3; s++)
+    {
+        std::vector<cv::Point2f> points = getPoints(sizes[s], s);
+        PointsConnected connected = {points, thresholds[s]};
+        std::vector<std::vector<int> > components = getComponentsBruteForce(points.size(), connected);
+        std::vector<std::vector<cv::Point2f> > expected;
+        for (int c = 0; c < components.size(); c++)
+        {
+            if (components[c].size() >= 6)
+            {
+                expected.push_back(std::vector<cv::Point2f>());
+                for (int k = 0; k < components[c].size(); k++)
+                {
+                    expected.back().push_back(points[components[c][k]]);
+                }
+            }
+        }
+
+        FlowClusterer clusterer;
+        EXPECT_EQ(expected, clusterer.clusterEuclidean(points, thresholds[s], 6)) << sizes[s] << " points";
+    }
+}
+
+TEST(FlowClusterer, GetClustersMatchesConnectedComponents)
+{
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> jitter(-1.5f, 1.5f);
+    std::uniform_real_distribution<float> angle(0.0f, 2.0f * CV_PI);
+    std::normal_distribution<float> turn(0.0f, 0.2f);
+    std::uniform_int_distribution<int> chance(0, 2);
+    FlowField flow;
+    flow.reset(cv::Size(320, 240), 4);
+    for (int i = 0; i < flow.size(); i++)
+    {
+        cv::Point pixel = flow.getPixel(i);
+        cv::Point2f start(pixel.x + jitter(rng), pixel.y + jitter(rng));
+        // two regions moving coherently, random motion or none elsewhere
+        float a;
+        if (pixel.x < 100 && pixel.y < 100)
+        {
+            a = 0.5f + turn(rng);
+        }
+        else if (pixel.x > 200 && pixel.y > 120)
+        {
+            a = 2.5f + turn(rng);
+        }
+        else if (chance(rng) == 0)
+        {
+            a = angle(rng);
+        }
+        else
+        {
+            flow.setVector(i, start, cv::Point2f(0.0f, 0.0f));
+            continue;
+        }
+        flow.setVector(i, start, cv::Point2f(3.0f * std::cos(a), 3.0f * std::sin(a)));
+    }
+
+    std::vector<cv::Vec4d> vectors;
+    for (int i = 0; i < flow.size(); i++)
+    {
+        if (flow.isMoving(i))
+        {
+            vectors.push_back(flow.getVector(i));
+        }
+    }
+    double thresholds[] = {5.0, 9.0};
+    for (int t = 0; t < 2; t++)
+    {
+        double angular_threshold = 0.4;
+        VectorsConnected connected = {vectors, thresholds[t], std::cos(angular_threshold)};
+        std::vector<std::vector<int> > components = getComponentsBruteForce(vectors.size(), connected);
+        std::vector<std::vector<cv::Vec4d> > expected;
+        for (int c = 0; c < components.size(); c++)
+        {
+            if (components[c].size() >= 6)
+            {
+                expected.push_back(std::vector<cv::Vec4d>());
+                for (int k = 0; k < components[c].size(); k++)
+                {
+                    expected.back().push_back(vectors[components[c][k]]);
+                }
+            }
+        }
+
+        FlowClusterer clusterer;
+        std::vector<std::vector<cv::Vec4d> > clusters = clusterer.getClusters(flow, thresholds[t], angular_threshold, 6);
+        EXPECT_GE(clusters.size(), 2) << "threshold " << thresholds[t];
+        EXPECT_EQ(expected, clusters) << "threshold " << thresholds[t];
+    }
+}
+
+TEST(FlowClusterer, ClusterFlowVectorsKeepsCentresOfStillScene)
+{
+    std::vector<cv::Point2f> blobs = getBlobCentres();
+    FlowField flow = getBlobs(blobs);
+    FlowClusterer clusterer;
+    cv::Mat previous;
+    for (int frame = 0; frame < 5; frame++)
+    {
+        std::vector<int> labels;
+        cv::Mat centers = clusterer.clusterFlowVectors(flow, labels);
+        ASSERT_EQ(blobs.size(), centers.rows);
+        // one centre per blob
+        std::vector<int> blob_centers;
+        for (int b = 0; b < blobs.size(); b++)
+        {
+            int c = findCenter(centers, blobs[b], 1.0);
+            EXPECT_NE(-1, c) << "frame " << frame << ", blob " << b;
+            EXPECT_EQ(blob_centers.end(), std::find(blob_centers.begin(), blob_centers.end(), c)) << "frame " << frame << ", blob " << b;
+            blob_centers.push_back(c);
+        }
+        // the centres stay with their blobs across frames
+        if (frame > 0)
+        {
+            for (int c = 0; c < centers.rows; c++)
+            {
+                EXPECT_NEAR(previous.at<float>(c, 0), centers.at<float>(c, 0), 0.5) << "frame " << frame;
+                EXPECT_NEAR(previous.at<float>(c, 1), centers.at<float>(c, 1), 0.5) << "frame " << frame;
+            }
+        }
+        previous = centers;
+
+        // moving cells are labelled with the centre of their blob
+        ASSERT_EQ(flow.size(), labels.size());
+        for (int i = 0; i < flow.size(); i++)
+        {
+            if (!flow.isMoving(i))
+            {
+                EXPECT_EQ(-1, labels[i]) << "cell " << i;
+                continue;
+            }
+            cv::Vec4d vector = flow.getVector(i);
+            EXPECT_EQ(findCenter(centers, cv::Point2f(vector[0], vector[1]), 2.0), labels[i]) << "cell " << i;
+        }
+    }
+}
+
+TEST(FlowClusterer, ClusterFlowVectorsMovesEmptyCentre)
+{
+    std::vector<cv::Point2f> blobs = getBlobCentres();
+    FlowClusterer clusterer;
+    clusterer.clusterFlowVectors(getBlobs(blobs));
+
+    // the first blob stops and one appears elsewhere; the centre that gets
+    // no samples is moved at once, and within a few frames every blob has
+    // a centre again
+    cv::Point2f stopped = blobs[0];
+    blobs[0] = cv::Point2f(320.0f, 400.0f);
+    FlowField flow = getBlobs(blobs);
+    cv::Mat centers = clusterer.clusterFlowVectors(flow);
+    ASSERT_EQ(blobs.size(), centers.rows);
+    EXPECT_EQ(-1, findCenter(centers, stopped, 50.0));
+    for (int frame = 0; frame < 8; frame++)
+    {
+        centers = clusterer.clusterFlowVectors(flow);
+    }
+    for (int b = 0; b < blobs.size(); b++)
+    {
+        EXPECT_NE(-1, findCenter(centers, blobs[b], 1.0)) << "blob " << b;
+    }
+}
@@ -0,0 +1,139 @@
+/* test_outlier_detector.cpp
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include <motion_detection/outlier_detector.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+const int NUM_FRAMES = 5;
+
+/**
+ * Trajectories of a background moving under a smooth camera motion, with
+ * every moving_step-th point taking random steps that fit no subspace.
+ */
+std::vector<std::vector<cv::Point2f> > getTrajectories(int num_trajectories, int moving_step, unsigned int seed)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0.0f, 0.05f);
+    std::uniform_real_distribution<float> uniform(0.0f, 640.0f);
+    std::normal_distribution<float> step(0.0f, 3.0f);
+    std::vector<std::vector<cv::Point2f> > trajectories;
+    for (int i = 0; i < num_trajectories; i++)
+    {
+        float x = uniform(rng);
+        float y = uniform(rng) * 0.75f;
+        bool moving = (i % moving_step == 0);
+        std::vector<cv::Point2f> trajectory;
+        cv::Point2f walk(x, y);
+        for (int k = 0; k < NUM_FRAMES; k++)
+        {
+            if (moving)
+            {
+                walk += cv::Point2f(step(rng), step(rng));
+                trajectory.push_back(walk);
+                continue;
+            }
+            float dx = (1.0f + 0.001f * x) * k;
+            float dy = (0.5f + 0.002f * y) * k;
+            trajectory.push_back(cv::Point2f(x + dx + noise(rng), y + dy + noise(rng)));
+        }
+        trajectories.push_back(trajectory);
+    }
+    return trajectories;
+}
+
+/**
+ * Fits the trajectories with 1 and with several threads, using the same
+ * seed, and expects the same outliers and inliers.
+ */
+void expectSameForAnyNumberOfThreads(const std::vector<std::vector<cv::Point2f> > &trajectories, int max_trajectories)
+{
+    OutlierDetector serial;
+    serial.setRansacParameters(3, 1);
+    serial.setMaxTrajectories(max_trajectories);
+    std::vector<cv::Point2f> expected_outliers;
+    std::vector<std::vector<cv::Point2f> > expected = serial.fitSubspace(trajectories, expected_outliers, 2, 0.5);
+
+    int thread_counts[] = {2, 3, 8};
+    for (int c = 0; c < 3; c++)
+    {
+        OutlierDetector detector;
+        detector.setRansacParameters(3, thread_counts[c]);
+        detector.setMaxTrajectories(max_trajectories);
+        std::vector<cv::Point2f> outliers;
+        std::vector<std::vector<cv::Point2f> > inliers = detector.fitSubspace(trajectories, outliers, 2, 0.5);
+        EXPECT_EQ(expected_outliers, outliers) << thread_counts[c] << " threads";
+        EXPECT_EQ(expected, inliers) << thread_counts[c] << " threads";
+    }
+}
+
+}
+
+TEST(OutlierDetector, FitSubspaceFindsMovingPoints)
+{
+    std::vector<std::vector<cv::Point2f> > trajectories = getTrajectories(600, 17, 7);
+    OutlierDetector detector;
+    detector.setRansacParameters(3, 1);
+    std::vector<cv::Point2f> outliers;
+    detector.fitSubspace(trajectories, outliers, 2, 0.5);
+
+    // a random walk can come close to the subspace by chance, so only most
+    // of them have to be found
+    int num_moving = 0;
+    int num_found = 0;
+    for (int i = 0; i < trajectories.size(); i += 17)
+    {
+        num_moving++;
+        if (std::find(outliers.begin(), outliers.end(), trajectories[i][NUM_FRAMES - 2]) != outliers.end())
+        {
+            num_found++;
+        }
+    }
+    EXPECT_GE(num_found, 0.9 * num_moving);
+}
+
+TEST(OutlierDetector, FitSubspaceSameForAnyNumberOfThreads)
+{
+    for (int t = 0; t < 2; t++)
+    {
+        SCOPED_TRACE(t);
+        expectSameForAnyNumberOfThreads(getTrajectories(600 + 500 * t, 17, 11 + t), 0);
+    }
+}
+
+TEST(OutlierDetector, FitSubsetSameForAnyNumberOfThreads)
+{
+    // the fit runs on a stratified subset, the rest is only classified
+    expectSameForAnyNumberOfThreads(getTrajectories(1600, 17, 13), 500);
+}
+
+TEST(OutlierDetector, FitSubspaceReusesThreadsAcrossFits)
+{
+    // the threads of one detector are kept between fits of different sizes,
+    // and every fit draws other hypotheses than the one before
+    OutlierDetector detector;
+    detector.setRansacParameters(3, 8);
+    OutlierDetector serial;
+    serial.setRansacParameters(3, 1);
+    for (int t = 0; t < 3; t++)
+    {
+        std::vector<std::vector<cv::Point2f> > trajectories = getTrajectories(2100 - 700 * t, 17, 21 + t);
+        std::vector<cv::Point2f> expected_outliers;
+        std::vector<std::vector<cv::Point2f> > expected = serial.fitSubspace(trajectories, expected_outliers, 2, 0.5);
+
+        std::vector<cv::Point2f> outliers;
+        std::vector<std::vector<cv::Point2f> > inliers = detector.fitSubspace(trajectories, outliers, 2, 0.5);
+        EXPECT_EQ(expected_outliers, outliers) << "fit " << t;
+        EXPECT_EQ(expected, inliers) << "fit " << t;
+    }
+}
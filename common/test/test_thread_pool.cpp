@@ -0,0 +1,85 @@
+/* test_thread_pool.cpp
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include <motion_detection/thread_pool.h>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+namespace
+{
+
+const int NUM_ROUNDS = 1000;
+
+/**
+ * Two strands that post to each other until they have run NUM_ROUNDS tasks
+ * together.
+ */
+struct PingPong
+{
+    ThreadPool *pool;
+    int strands[2];
+    std::atomic<int> count;
+
+    void run(int side)
+    {
+        if (++count < NUM_ROUNDS)
+        {
+            pool->post(strands[1 - side], std::bind(&PingPong::run, this, 1 - side));
+        }
+    }
+};
+
+}
+
+TEST(ThreadPool, RunsTasksOfAStrandInOrder)
+{
+    ThreadPool pool(4);
+    int strand = pool.addStrand();
+    std::vector<int> order;
+    for (int i = 0; i < 100; i++)
+    {
+        pool.post(strand, [&order, i]() { order.push_back(i); });
+    }
+    pool.waitIdle(strand);
+    ASSERT_EQ(100, order.size());
+    for (int i = 0; i < 100; i++)
+    {
+        EXPECT_EQ(i, order[i]);
+    }
+}
+
+TEST(ThreadPool, RefusesTasksBeyondCapacity)
+{
+    ThreadPool pool(1);
+    int blocker = pool.addStrand();
+    int bounded = pool.addStrand(2);
+    std::atomic<bool> release(false);
+    // keeps the only worker busy, so the bounded strand cannot run
+    pool.post(blocker, [&release]() { while (!release) {} });
+    EXPECT_TRUE(pool.post(bounded, []() {}));
+    EXPECT_TRUE(pool.post(bounded, []() {}));
+    EXPECT_FALSE(pool.post(bounded, []() {}));
+    release = true;
+    pool.waitIdle(bounded);
+}
+
+TEST(ThreadPool, WaitsForStrandsThatPostToEachOther)
+{
+    ThreadPool pool(3);
+    PingPong ping_pong;
+    ping_pong.pool = &pool;
+    ping_pong.strands[0] = pool.addStrand();
+    ping_pong.strands[1] = pool.addStrand();
+    ping_pong.count = 0;
+    pool.post(ping_pong.strands[0], std::bind(&PingPong::run, &ping_pong, 0));
+    std::vector<int> strands(ping_pong.strands, ping_pong.strands + 2);
+    pool.waitIdle(strands);
+    EXPECT_EQ(NUM_ROUNDS, ping_pong.count);
+}
@@ -0,0 +1,103 @@
+/* test_union_find.cpp
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include <motion_detection/union_find.h>
+#include <gtest/gtest.h>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+const int NUM_ELEMENTS = 20000;
+const int NUM_UNIONS = 15000;
+
+std::vector<std::pair<int, int> > getRandomPairs(unsigned int seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> element(0, NUM_ELEMENTS - 1);
+    std::vector<std::pair<int, int> > pairs(NUM_UNIONS);
+    for (int i = 0; i < pairs.size(); i++)
+    {
+        pairs[i] = std::make_pair(element(rng), element(rng));
+    }
+    return pairs;
+}
+
+// unites the pairs from num_threads threads, each taking every
+// num_threads-th pair
+void uniteConcurrently(AtomicUnionFind &sets, const std::vector<std::pair<int, int> > &pairs, int num_threads)
+{
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++)
+    {
+        threads.push_back(std::thread([&sets, &pairs, num_threads, t]()
+        {
+            for (int i = t; i < pairs.size(); i += num_threads)
+            {
+                sets.unite(pairs[i].first, pairs[i].second);
+            }
+        }));
+    }
+    for (int t = 0; t < threads.size(); t++)
+    {
+        threads[t].join();
+    }
+}
+
+}
+
+TEST(UnionFind, UnitesSets)
+{
+    UnionFind sets;
+    sets.reset(6);
+    sets.unite(0, 1);
+    sets.unite(2, 3);
+    sets.unite(1, 3);
+    EXPECT_EQ(6, sets.size());
+    EXPECT_EQ(sets.find(0), sets.find(2));
+    EXPECT_EQ(sets.find(1), sets.find(3));
+    EXPECT_NE(sets.find(0), sets.find(4));
+    EXPECT_NE(sets.find(4), sets.find(5));
+}
+
+TEST(AtomicUnionFind, MatchesUnionFindForAnyNumberOfThreads)
+{
+    std::vector<std::pair<int, int> > pairs = getRandomPairs(11);
+    UnionFind expected;
+    expected.reset(NUM_ELEMENTS);
+    for (int i = 0; i < pairs.size(); i++)
+    {
+        expected.unite(pairs[i].first, pairs[i].second);
+    }
+
+    int thread_counts[] = {1, 2, 4, 8};
+    for (int c = 0; c < 4; c++)
+    {
+        AtomicUnionFind sets;
+        sets.reset(NUM_ELEMENTS);
+        uniteConcurrently(sets, pairs, thread_counts[c]);
+        // same partition: an element is with the representative of its
+        // expected set exactly when the expected sets agree
+        for (int i = 0; i < NUM_ELEMENTS; i++)
+        {
+            int root = expected.find(i);
+            ASSERT_EQ(sets.find(root), sets.find(i)) << thread_counts[c] << " threads, element " << i;
+        }
+        int num_sets = 0;
+        int expected_num_sets = 0;
+        for (int i = 0; i < NUM_ELEMENTS; i++)
+        {
+            num_sets += (sets.find(i) == i);
+            expected_num_sets += (expected.find(i) == i);
+        }
+        EXPECT_EQ(expected_num_sets, num_sets) << thread_counts[c] << " threads";
+    }
+}
@@ -0,0 +1,328 @@
+/* motion_detection_offline.cpp
+ *
+ * Copyright (C) 2014 Santosh Thoduka
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+/*
+ * Runs the detection pipeline on a video file or an image directory without
+ * ROS and writes the bounding boxes in the MotionLogger format. Long inputs
+ * are split into chunks that are processed in parallel; every chunk starts
+ * a full window early so that its first logged frame has complete
+ * trajectories.
+ */
+
+#include <motion_detection/motion_detector.h>
+#include <motion_detection/motion_logger.h>
+#include <motion_detection/thread_pool.h>
+#include <opencv2/highgui/highgui.hpp>
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+namespace bfs = boost::filesystem;
+
+namespace
+{
+
+struct Options
+{
+    std::string input;
+    std::string log_path;
+    PipelineConfig config;
+    bool egomotion;
+    bool downsample;
+    int num_threads;
+    int chunk_size;
+};
+
+struct FrameBoxes
+{
+    int frame_number;
+    std::vector<cv::Rect> bounding_boxes;
+};
+
+/**
+ * Random access to the frames of a video or of a sorted image directory.
+ * Each chunk opens its own reader.
+ */
+class FrameReader
+{
+    public:
+        explicit FrameReader(const std::string &input) : input_(input), next_frame_(0)
+        {
+            if (bfs::is_directory(input))
+            {
+                for (bfs::directory_iterator it(input); it != bfs::directory_iterator(); ++it)
+                {
+                    std::string extension = it->path().extension().string();
+                    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+                    if (extension == ".jpg" || extension == ".jpeg" || extension == ".png" ||
+                        extension == ".bmp" || extension == ".ppm" || extension == ".pgm")
+                    {
+                        files_.push_back(it->path().string());
+                    }
+                }
+                std::sort(files_.begin(), files_.end());
+            }
+            else
+            {
+                capture_.open(input);
+            }
+        }
+
+        bool isOpen() const
+        {
+            return !files_.empty() || capture_.isOpened();
+        }
+
+        // -1 if the number of frames is unknown
+        int size()
+        {
+            if (!files_.empty())
+            {
+                return files_.size();
+            }
+            int count = capture_.get(CV_CAP_PROP_FRAME_COUNT);
+            return count > 0 ? count : -1;
+        }
+
+        void seek(int frame)
+        {
+            if (files_.empty() && frame != next_frame_)
+            {
+                capture_.set(CV_CAP_PROP_POS_FRAMES, frame);
+            }
+            next_frame_ = frame;
+        }
+
+        bool read(cv::Mat &image)
+        {
+            if (!files_.empty())
+            {
+                if (next_frame_ >= files_.size())
+                {
+                    return false;
+                }
+                image = cv::imread(files_.at(next_frame_++));
+                return !image.empty();
+            }
+            next_frame_++;
+            return capture_.read(image);
+        }
+
+    private:
+        std::string input_;
+        std::vector<std::string> files_;
+        cv::VideoCapture capture_;
+        int next_frame_;
+};
+
+void processChunk(const Options &options, int begin, int end, std::vector<FrameBoxes> &boxes)
+{
+    FrameReader reader(options.input);
+    FrameCache frame_cache;
+    MotionDetector detector(options.egomotion);
+    MotionDetectionResult result;
+
+    const PipelineConfig &config = options.config;
+    int trajectory_size = config.getTrajectorySize(options.egomotion);
+    frame_cache.setCapacity(trajectory_size);
+
+    // warm up on the frames before the chunk so the window is full at begin
+    int first = std::max(0, begin - (trajectory_size - 1) * config.skip_frames);
+    first -= first % config.skip_frames;
+    reader.seek(first);
+
+    cv::Mat image;
+    for (int frame_number = first; end < 0 || frame_number < end; frame_number++)
+    {
+        if (!reader.read(image))
+        {
+            break;
+        }
+        if (frame_number % config.skip_frames != 0)
+        {
+            continue;
+        }
+        int scale = (options.downsample && image.cols > 320) ? 2 : 1;
+        const CachedFrame &frame = frame_cache.addFrame(image, ImagePreprocessor::BGR8, scale, false);
+        if (!detector.track(config, frame, result) || frame_number < begin)
+        {
+            continue;
+        }
+        detector.detect(config, result);
+
+        FrameBoxes frame_boxes;
+        frame_boxes.frame_number = frame_number;
+        frame_boxes.bounding_boxes = result.bounding_boxes;
+        boxes.push_back(frame_boxes);
+    }
+}
+
+void printUsage(const char *name)
+{
+    std::cerr << "usage: " << name << " <video file | image directory> <log file> [options]" << std::endl
+              << "  --pixel_step N            grid spacing of the tracked points (10)" << std::endl
+              << "  --num_motions N           motions in the background subspace (2)" << std::endl
+              << "  --sigma X                 outlier threshold of the subspace fit (0.5)" << std::endl
+              << "  --min_vector_size X       smaller flow vectors are ignored (1.0)" << std::endl
+              << "  --seed_border N           seed new tracks only N pixels inside the image (10)" << std::endl
+              << "  --no_merge_tracks         keep tracks that converge onto one grid cell" << std::endl
+              << "  --distance_threshold X    clustering distance in pixels (50.0)" << std::endl
+              << "  --min_cluster_size N      smallest cluster of outlier points (6)" << std::endl
+              << "  --angular_threshold X     clustering angle without egomotion (0.15)" << std::endl
+              << "  --clustering_method M     connected or density (connected)" << std::endl
+              << "  --density_min_points N    neighbours of a dense point with density clustering (4)" << std::endl
+              << "  --skip_frames N           only process every Nth frame (1)" << std::endl
+              << "  --seed N                  seed of the subspace fit (0)" << std::endl
+              << "  --ransac_threads N        threads per subspace fit, 0 for one per core (1)" << std::endl
+              << "  --ransac_confidence X     stop the subspace fit at this confidence (0.99)" << std::endl
+              << "  --ransac_max_iterations N hypotheses per subspace fit at most (50)" << std::endl
+              << "  --max_trajectories N      fit the subspace on at most N trajectories, 0 for all (0)" << std::endl
+              << "  --warm_start              start each subspace fit from the previous inliers" << std::endl
+              << "  --warm_start_min_inlier_ratio X" << std::endl
+              << "                            run RANSAC when fewer inliers are left (0.5)" << std::endl
+              << "  --no_egomotion            cluster the flow instead of fitting a subspace" << std::endl
+              << "  --downsample              halve images wider than 320 pixels" << std::endl
+              << "  --threads N               worker threads, 0 for one per core (0)" << std::endl
+              << "  --chunk_size N            frames per parallel chunk (500)" << std::endl;
+}
+
+bool parseOptions(int argc, char **argv, Options &options)
+{
+    if (argc < 3)
+    {
+        return false;
+    }
+    options.input = argv[1];
+    options.log_path = argv[2];
+    options.egomotion = true;
+    options.downsample = false;
+    options.num_threads = 0;
+    options.chunk_size = 500;
+    // the chunks already keep every core busy
+    options.config.ransac_threads = 1;
+    options.config.clustering_threads = 1;
+
+    for (int i = 3; i < argc; i++)
+    {
+        std::string option(argv[i]);
+        if (option == "--no_egomotion")
+        {
+            options.egomotion = false;
+            continue;
+        }
+        if (option == "--downsample")
+        {
+            options.downsample = true;
+            continue;
+        }
+        if (option == "--no_merge_tracks")
+        {
+            options.config.merge_tracks = false;
+            continue;
+        }
+        if (option == "--warm_start")
+        {
+            options.config.subspace_warm_start = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            return false;
+        }
+        const char *value = argv[++i];
+        if (option == "--pixel_step") options.config.pixel_step = std::atoi(value);
+        else if (option == "--num_motions") options.config.num_motions = std::atoi(value);
+        else if (option == "--sigma") options.config.sigma = std::atof(value);
+        else if (option == "--min_vector_size") options.config.min_vector_size = std::atof(value);
+        else if (option == "--seed_border") options.config.seed_border = std::atoi(value);
+        else if (option == "--distance_threshold") options.config.distance_threshold = std::atof(value);
+        else if (option == "--min_cluster_size") options.config.min_cluster_size = std::atoi(value);
+        else if (option == "--angular_threshold") options.config.angular_threshold = std::atof(value);
+        else if (option == "--clustering_method") options.config.clustering_method = value;
+        else if (option == "--density_min_points") options.config.density_min_points = std::atoi(value);
+        else if (option == "--skip_frames") options.config.skip_frames = std::atoi(value);
+        else if (option == "--seed") options.config.ransac_seed = std::atoi(value);
+        else if (option == "--ransac_threads") options.config.ransac_threads = std::atoi(value);
+        else if (option == "--ransac_confidence") options.config.ransac_confidence = std::atof(value);
+        else if (option == "--ransac_max_iterations") options.config.ransac_max_iterations = std::atoi(value);
+        else if (option == "--max_trajectories") options.config.subspace_max_trajectories = std::atoi(value);
+        else if (option == "--warm_start_min_inlier_ratio") options.config.warm_start_min_inlier_ratio = std::atof(value);
+        else if (option == "--threads") options.num_threads = std::atoi(value);
+        else if (option == "--chunk_size") options.chunk_size = std::atoi(value);
+        else return false;
+    }
+    bool known_method = options.config.clustering_method == "connected" || options.config.clustering_method == "density";
+    return options.config.pixel_step > 0 && options.config.seed_border >= 0 && options.config.skip_frames > 0 && options.chunk_size > 0 && known_method;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    FrameReader reader(options.input);
+    if (!reader.isOpen())
+    {
+        std::cerr << "could not open " << options.input << std::endl;
+        return 1;
+    }
+    int num_frames = reader.size();
+
+    // chunks are only split when the length is known, otherwise the whole
+    // input is one chunk read to its end
+    std::vector<std::pair<int, int> > chunks;
+    if (num_frames < 0)
+    {
+        chunks.push_back(std::make_pair(0, -1));
+    }
+    else
+    {
+        for (int begin = 0; begin < num_frames; begin += options.chunk_size)
+        {
+            chunks.push_back(std::make_pair(begin, std::min(begin + options.chunk_size, num_frames)));
+        }
+    }
+
+    std::vector<std::vector<FrameBoxes> > boxes(chunks.size());
+    {
+        ThreadPool pool(options.num_threads);
+        std::cerr << "processing " << chunks.size() << " chunks on " << pool.getNumThreads() << " threads" << std::endl;
+        for (int i = 0; i < chunks.size(); i++)
+        {
+            int strand = pool.addStrand();
+            pool.post(strand, std::bind(processChunk, std::cref(options), chunks.at(i).first, chunks.at(i).second, std::ref(boxes.at(i))));
+        }
+        // the pool finishes all chunks before it is destroyed
+    }
+
+    MotionLogger logger(options.log_path);
+    int num_boxes = 0;
+    for (int i = 0; i < boxes.size(); i++)
+    {
+        for (int j = 0; j < boxes.at(i).size(); j++)
+        {
+            const FrameBoxes &frame_boxes = boxes.at(i).at(j);
+            for (int k = 0; k < frame_boxes.bounding_boxes.size(); k++)
+            {
+                logger.writeBoundingBox(frame_boxes.bounding_boxes.at(k), frame_boxes.frame_number, k);
+                num_boxes++;
+            }
+        }
+    }
+    std::cerr << "wrote " << num_boxes << " bounding boxes to " << options.log_path << std::endl;
+    return 0;
+}
@@ -10,10 +10,17 @@
 
 #include <ros/ros.h>
 #include <image_transport/image_transport.h>
+#include <std_srvs/Empty.h>
+#include <boost/shared_ptr.hpp>
+#include <memory>
+#include <mutex>
+#include <atomic>
 #include <nav_msgs/Odometry.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <motion_detection/expected_flow_calculator.h>
 #include <motion_detection/optical_flow_calculator.h>
+#include <motion_detection/motion_detector.h>
+#include <motion_detection/frame_cache.h>
 #include <motion_detection/flow_clusterer.h>
 #include <motion_detection/flow_difference_calculator.h>
 #include <motion_detection/optical_flow_visualizer.h>
@@ -22,11 +29,15 @@
 #include <motion_detection/outlier_detector.h>
 #include <motion_detection/trajectory_visualizer.h>
 #include <motion_detection/motion_logger.h>
+#include <motion_detection/pipeline_config.h>
+#include <motion_detection/bounded_queue.h>
+#include <motion_detection/thread_pool.h>
 
 class MotionDetectionNode
 {
     public:
-        MotionDetectionNode(ros::NodeHandle &nh);
+        // stages run on pool, or on a private pool if it is NULL
+        MotionDetectionNode(ros::NodeHandle &nh, ThreadPool *pool = NULL);
         virtual ~MotionDetectionNode();
 
         void run();
@@ -37,13 +48,68 @@ class MotionDetectionNode
         void cameraInfoCallback(const sensor_msgs::CameraInfo &camera_info);
         
     private:
-        void writeVectors(const cv::Mat &flow_vectors, const std::string &filename);
+        void writeVectors(const PipelineConfig &config, const FlowField &flow_vectors, const std::string &filename);
         void writeTrajectories(const std::vector<std::vector<cv::Point2f> > &trajectories, const std::string &filename);
-        void runOpticalFlow(const cv::Mat &image1, const cv::Mat &image2, cv::Mat &optical_flow_vectors);
-        void runOpticalFlowTrajectory(const std::vector<cv::Mat> &images, cv::Mat &optical_flow_vectors, std::vector<std::vector<cv::Point2f> > &trajectories, cv::Mat &optical_flow_image);
-        void clusterFlow(const cv::Mat &image, const cv::Mat &flow_vectors, std::vector<std::vector<cv::Vec4d> > &clusters);
+        void runOpticalFlow(const PipelineConfig &config, const cv::Mat &image1, const cv::Mat &image2, FlowField &optical_flow_vectors);
+        void runOpticalFlowTrajectory(const PipelineConfig &config, const std::vector<cv::Mat> &images, const std::vector<std::vector<cv::Mat> > &pyramids, FlowField &optical_flow_vectors, std::vector<std::vector<cv::Point2f> > &trajectories, cv::Mat &optical_flow_image);
+        void showOpticalFlow(const PipelineConfig &config, const cv::Mat &image, const FlowField &optical_flow_vectors, cv::Mat &optical_flow_image);
+        void clusterFlow(const PipelineConfig &config, const cv::Mat &image, const FlowField &flow_vectors, std::vector<std::vector<cv::Vec4d> > &clusters);
 
-        void detectOutliers(const cv::Mat &original_image, const cv::Mat &optical_flow_vectors, cv::Mat &outlier_mask, bool include_zeros);
+        void detectOutliers(const PipelineConfig &config, const cv::Mat &original_image, const FlowField &optical_flow_vectors, cv::Mat &outlier_mask, bool include_zeros);
+
+        // debug images that have to be rendered for the current frame
+        struct OutputRequest
+        {
+            bool optical_flow_image;
+            bool trajectory_image;
+            bool cluster_image;
+            bool combined_image;
+            bool raw_image;
+            bool save_frame;
+            std::string frames_path;
+
+            bool anyImage() const;
+        };
+
+        // a received frame waiting to be tracked
+        struct IngestItem
+        {
+            sensor_msgs::ImageConstPtr image;
+            boost::shared_ptr<const PipelineConfig> config;
+            int frame_count;
+            ros::WallTime received;
+        };
+
+        // everything a frame carries from tracking to publishing
+        struct FrameData
+        {
+            boost::shared_ptr<const PipelineConfig> config;
+            OutputRequest request;
+            int frame_count;
+            ros::WallTime received;
+            cv::Mat image;
+            MotionDetectionResult result;
+        };
+
+        // pipeline stages
+        void admitFrame(const IngestItem &item);
+        void trackFrame(const IngestItem &item);
+        void detectMotion(FrameData &data);
+        void publishResults(FrameData &data);
+        void reportLatency(const FrameData &data);
+        void trackNextFrame();
+        void detectAndForward(const boost::shared_ptr<FrameData> &data);
+        void outputFrame(const boost::shared_ptr<FrameData> &data);
+
+        bool hasSubscribers(const image_transport::Publisher &publisher);
+        OutputRequest getOutputRequest(const PipelineConfig &config, int frame_count);
+        void combineImages(const cv::Mat &top_image, const cv::Mat &bottom_image, cv::Mat &combined_image);
+        const CachedFrame &ingestImage(const sensor_msgs::ImageConstPtr &image, bool keep_colour);
+
+        // reads all per-frame parameters from the parameter server
+        PipelineConfig loadConfig();
+        boost::shared_ptr<const PipelineConfig> getConfig();
+        bool reloadConfigCallback(std_srvs::Empty::Request &request, std_srvs::Empty::Response &response);
     private:
         ros::NodeHandle nh_;
         image_transport::ImageTransport it_;
@@ -58,6 +124,7 @@ class MotionDetectionNode
         image_transport::Publisher compensated_flow_publisher_;
         image_transport::Publisher clustered_flow_publisher_;
         image_transport::Publisher background_subtraction_publisher_;
+        ros::ServiceServer reload_config_service_;
         bool cloud_received_;
         bool image_received_;
         bool odom_received_;        
@@ -72,19 +139,49 @@ class MotionDetectionNode
         bool write_trajectories_;
         bool log_contours_;
         bool include_zeros_;
-        int pixel_step_;
-        double min_vector_size_;
-        int trajectory_size_;
+        bool downsample_;
         int global_frame_count_;
         bool egomotion_;
 
+        boost::shared_ptr<const PipelineConfig> config_;
+        std::mutex config_mutex_;
+
+        bool use_pipeline_;
+        bool keep_latest_;
+        int ingest_stride_;
+        double max_ingest_latency_;
+        BoundedQueue<IngestItem> ingest_queue_;
+        ThreadPool *pool_;
+        // the pool is shared with other streams
+        bool shared_pool_;
+        std::unique_ptr<ThreadPool> own_pool_;
+        int tracking_strand_;
+        int detection_strand_;
+        int output_strand_;
+
+        // frames tracked but not yet published
+        std::atomic<int> frames_downstream_;
+        int max_frames_downstream_;
+        std::atomic<long> received_frames_;
+        // dropped by the ingest policy
+        std::atomic<long> dropped_frames_;
+        // dropped for waiting longer than max_ingest_latency
+        std::atomic<long> stale_frames_;
+        // times tracking found detection and output full
+        std::atomic<long> tracking_waits_;
+        double latency_sum_;
+        double latency_max_;
+        int latency_count_;
+        ros::WallTime last_latency_report_;
+
         sensor_msgs::PointCloud2 cloud_;
-        std::list<sensor_msgs::ImageConstPtr> raw_images_;
+        FrameCache frame_cache_;
         sensor_msgs::ImageConstPtr raw_image1_;
         sensor_msgs::ImageConstPtr raw_image2_;
         nav_msgs::Odometry odom_;
         nav_msgs::Odometry prev_odom_;
         OpticalFlowCalculator ofc_;
+        MotionDetector detector_;
         ExpectedFlowCalculator efc_;
         FlowClusterer fc_;
         FlowDifferenceCalculator fdc_;
@@ -14,11 +14,12 @@
 #include <cv_bridge/cv_bridge.h>
 #include <opencv2/calib3d/calib3d.hpp>
 #include <iostream>
+#include <ctime>
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
-MotionDetectionNode::MotionDetectionNode(ros::NodeHandle &nh): nh_(nh), it_(nh), rng(12345), output_cap_("/home/santosh/test.avi", CV_FOURCC('D', 'I', 'V', 'X'), 30, cv::Size(320, 240), true)
+MotionDetectionNode::MotionDetectionNode(ros::NodeHandle &nh, ThreadPool *pool): nh_(nh), it_(nh), pool_(pool), shared_pool_(pool != NULL), rng(12345)
 {
     cloud_received_ = false;
     image_received_ = false;
@@ -26,7 +27,6 @@ MotionDetectionNode::MotionDetectionNode(ros::NodeHandle &nh): nh_(nh), it_(nh),
     first_image_received_ = false;
     camera_params_set_ = false;
     first_run_ = true;
-    nh_.getParam("pixel_step", pixel_step_);
     frame_number_ = 0;
     global_frame_count_ = 0;
     write_trajectories_ = false;
@@ -34,14 +34,63 @@ MotionDetectionNode::MotionDetectionNode(ros::NodeHandle &nh): nh_(nh), it_(nh),
     nh_.param<bool>("use_odom", use_odom_, false);
     nh_.param<bool>("use_pointcloud", use_pointcloud_, false);
     nh_.param<bool>("record_video", record_video_, false);
+    // streams sharing a pool each record to a file named after the stream
+    std::string video_path = "/home/santosh/test.avi";
+    if (pool != NULL)
+    {
+        std::string stream = nh_.getNamespace();
+        video_path = "/home/santosh/" + stream.substr(stream.rfind('/') + 1) + ".avi";
+    }
+    nh_.param<std::string>("video_path", video_path, video_path);
+    if (record_video_)
+    {
+        output_cap_.open(video_path, CV_FOURCC('D', 'I', 'V', 'X'), 30, cv::Size(320, 240), true);
+    }
     nh_.param<bool>("use_all_frames", use_all_frames_, false);
     nh_.param<bool>("write_vectors", write_vectors_, false);
     nh_.param<bool>("log_contours", log_contours_, false);
     nh_.param<bool>("egomotion", egomotion_, true);
+    detector_.setEgomotion(egomotion_);
     std::string log_path;
     nh_.param<std::string>("log_path", log_path, "");
     nh_.param<bool>("include_zeros", include_zeros_, false);
-    nh_.param<double>("min_vector_size", min_vector_size_, 1.0);
+    // halve images wider than 320 pixels before processing
+    nh_.param<bool>("downsample", downsample_, false);
+    // overlap tracking, detection and output of consecutive frames
+    nh_.param<bool>("use_pipeline", use_pipeline_, true);
+    // frames that may wait for detection and for output each; once they
+    // are full, new frames wait in the ingest queue instead
+    int pipeline_queue_size;
+    nh_.param<int>("pipeline_queue_size", pipeline_queue_size, 2);
+    // at most ingest_queue_size frames wait for tracking; "latest" drops the
+    // oldest waiting frame, "every_nth" only admits every ingest_stride-th
+    // frame and drops new frames while the queue is full
+    int ingest_queue_size;
+    nh_.param<int>("ingest_queue_size", ingest_queue_size, 1);
+    std::string ingest_policy;
+    nh_.param<std::string>("ingest_policy", ingest_policy, "latest");
+    nh_.param<int>("ingest_stride", ingest_stride_, 2);
+    // frames older than this (in seconds) are dropped before tracking, 0 disables
+    nh_.param<double>("max_ingest_latency", max_ingest_latency_, 0.0);
+    keep_latest_ = (ingest_policy != "every_nth");
+    if (ingest_queue_size < 1)
+    {
+        ingest_queue_size = 1;
+    }
+    if (ingest_stride_ < 1)
+    {
+        ingest_stride_ = 1;
+    }
+    max_frames_downstream_ = 2 * std::max(pipeline_queue_size, 1);
+    frames_downstream_ = 0;
+    received_frames_ = 0;
+    dropped_frames_ = 0;
+    stale_frames_ = 0;
+    tracking_waits_ = 0;
+    latency_sum_ = 0.0;
+    latency_max_ = 0.0;
+    latency_count_ = 0;
+    last_latency_report_ = ros::WallTime::now();
 
     of_image_publisher_ = it_.advertise("optical_flow_image", 1);
     image1_publisher_ = it_.advertise("image1", 1);
@@ -51,6 +100,9 @@ MotionDetectionNode::MotionDetectionNode(ros::NodeHandle &nh): nh_(nh), it_(nh),
     clustered_flow_publisher_ = it_.advertise("clustered_flow_image", 1);
     background_subtraction_publisher_ = it_.advertise("background_subtraction_image", 1);
 
+    config_.reset(new PipelineConfig(loadConfig()));
+    reload_config_service_ = nh_.advertiseService("reload_config", &MotionDetectionNode::reloadConfigCallback, this);
+
     if (log_contours_)
     {
         ml_.setFileName(log_path);
@@ -60,7 +112,32 @@ MotionDetectionNode::MotionDetectionNode(ros::NodeHandle &nh): nh_(nh), it_(nh),
     {
         cloud_subscriber_ = nh_.subscribe("input_pointcloud", 1, &MotionDetectionNode::cloudCallback, this);
     }
-    image_subscriber_ = it_.subscribe("input_image", 0, &MotionDetectionNode::imageCallback, this);
+    if (use_pipeline_ && use_all_frames_)
+    {
+        // a single stream gets its own pool with one thread per stage
+        if (pool_ == NULL)
+        {
+            own_pool_.reset(new ThreadPool(3));
+            pool_ = own_pool_.get();
+        }
+        ingest_queue_.setCapacity(ingest_queue_size);
+        // the later strands hold at most max_frames_downstream_ frames,
+        // see trackNextFrame
+        tracking_strand_ = pool_->addStrand();
+        detection_strand_ = pool_->addStrand();
+        output_strand_ = pool_->addStrand();
+    }
+    else
+    {
+        pool_ = NULL;
+        // the subscriber queue of ingest_queue_size already keeps the latest
+        // frames, but how long they waited in it is not known
+        if (use_all_frames_ && max_ingest_latency_ > 0.0)
+        {
+            ROS_WARN("[%s] max_ingest_latency needs use_pipeline and is ignored", nh_.getNamespace().c_str());
+        }
+    }
+    image_subscriber_ = it_.subscribe("input_image", ingest_queue_size, &MotionDetectionNode::imageCallback, this);
     if (use_odom_)
     {
         odom_subscriber_ = nh_.subscribe("/odom", 1, &MotionDetectionNode::odomCallback, this);
@@ -71,16 +148,29 @@ MotionDetectionNode::MotionDetectionNode(ros::NodeHandle &nh): nh_(nh), it_(nh),
 
 MotionDetectionNode::~MotionDetectionNode()
 {
+    // frames already queued are still published before the node goes away;
+    // output posts back to tracking, so all stages have to be idle at once
+    if (pool_ != NULL)
+    {
+        image_subscriber_.shutdown();
+        std::vector<int> strands;
+        strands.push_back(tracking_strand_);
+        strands.push_back(detection_strand_);
+        strands.push_back(output_strand_);
+        pool_->waitIdle(strands);
+    }
 }
 
-void MotionDetectionNode::runOpticalFlow(const cv::Mat &image1, const cv::Mat &image2, cv::Mat &optical_flow_vectors)
+void MotionDetectionNode::runOpticalFlow(const PipelineConfig &config, const cv::Mat &image1, const cv::Mat &image2, FlowField &optical_flow_vectors)
 {
-    cv::Mat debug_image;
     cv::Mat optical_flow_image;
 
-    optical_flow_vectors = cv::Mat::zeros(image1.rows, image1.cols, CV_32FC4);
-    int num_vectors = ofc_.calculateOpticalFlow(image1, image2, optical_flow_vectors, pixel_step_, debug_image, min_vector_size_);
-    ofv_.showOpticalFlowVectors(image1, optical_flow_image, optical_flow_vectors, pixel_step_, CV_RGB(0, 0, 255), min_vector_size_);
+    int num_vectors = ofc_.calculateOpticalFlow(image1, image2, optical_flow_vectors, config.pixel_step, config.min_vector_size);
+    if (!hasSubscribers(of_image_publisher_) && !record_video_)
+    {
+        return;
+    }
+    ofv_.showOpticalFlowVectors(image1, optical_flow_image, optical_flow_vectors, CV_RGB(0, 0, 255), config.min_vector_size);
 
     publishImage(optical_flow_image, of_image_publisher_);
     if (record_video_)
@@ -91,14 +181,16 @@ void MotionDetectionNode::runOpticalFlow(const cv::Mat &image1, const cv::Mat &i
     }
 }
 
-void MotionDetectionNode::runOpticalFlowTrajectory(const std::vector<cv::Mat> &images, cv::Mat &optical_flow_vectors, std::vector<std::vector<cv::Point2f> > &trajectories, cv::Mat &optical_flow_image)
+void MotionDetectionNode::runOpticalFlowTrajectory(const PipelineConfig &config, const std::vector<cv::Mat> &images, const std::vector<std::vector<cv::Mat> > &pyramids, FlowField &optical_flow_vectors, std::vector<std::vector<cv::Point2f> > &trajectories, cv::Mat &optical_flow_image)
 {
-    cv::Mat debug_image;
-
-    optical_flow_vectors = cv::Mat::zeros(images[0].rows, images[0].cols, CV_32FC4);
-    int num_vectors = ofc_.calculateOpticalFlowTrajectory(images, optical_flow_vectors, trajectories, pixel_step_, debug_image, min_vector_size_);
+    int num_vectors = ofc_.calculateOpticalFlowTrajectory(pyramids, optical_flow_vectors, trajectories, config.pixel_step, config.min_vector_size);
 //    int num_vectors = ofc_.calculateOpticalFlow(image1, image2, optical_flow_vectors, pixel_step_, debug_image, min_vector_size_);
-    ofv_.showOpticalFlowVectors(images.back(), optical_flow_image, optical_flow_vectors, pixel_step_, CV_RGB(0, 0, 255), min_vector_size_);
+    showOpticalFlow(config, images.back(), optical_flow_vectors, optical_flow_image);
+}
+
+void MotionDetectionNode::showOpticalFlow(const PipelineConfig &config, const cv::Mat &image, const FlowField &optical_flow_vectors, cv::Mat &optical_flow_image)
+{
+    ofv_.showOpticalFlowVectors(image, optical_flow_image, optical_flow_vectors, CV_RGB(0, 0, 255), config.min_vector_size);
 
     publishImage(optical_flow_image, of_image_publisher_);
     if (record_video_)
@@ -109,23 +201,35 @@ void MotionDetectionNode::runOpticalFlowTrajectory(const std::vector<cv::Mat> &i
     }
 }
 
-void MotionDetectionNode::detectOutliers(const cv::Mat &original_image, const cv::Mat &optical_flow_vectors, cv::Mat &outlier_mask, bool include_zeros)
+void MotionDetectionNode::detectOutliers(const PipelineConfig &config, const cv::Mat &original_image, const FlowField &optical_flow_vectors, cv::Mat &outlier_mask, bool include_zeros)
 {
-    od_.findOutliers(optical_flow_vectors, outlier_mask, include_zeros, pixel_step_, false);
-    cv::Mat outlier_image;
-    ofv_.showFlowOutliers(original_image, outlier_image, optical_flow_vectors, outlier_mask, pixel_step_, false); 
+    od_.findOutliers(optical_flow_vectors, outlier_mask, include_zeros, false);
+    if (hasSubscribers(compensated_flow_publisher_))
+    {
+        cv::Mat outlier_image;
+        ofv_.showFlowOutliers(original_image, outlier_image, optical_flow_vectors, outlier_mask, false); 
 
-    publishImage(outlier_image, compensated_flow_publisher_);
+        publishImage(outlier_image, compensated_flow_publisher_);
+    }
 
-    cv::Mat outlier_vectors;
-    od_.getOutlierVectors(optical_flow_vectors, outlier_mask, outlier_vectors, pixel_step_);
+    FlowField outlier_vectors;
+    od_.getOutlierVectors(optical_flow_vectors, outlier_mask, outlier_vectors);
     std::vector<std::vector<cv::Vec4d> > clusters;
 
-    double distance_threshold, angular_threshold;
-    nh_.getParam("distance_threshold", distance_threshold);
-    nh_.getParam("angular_threshold", angular_threshold);
-    clusters = fc_.getClusters(outlier_vectors, pixel_step_, distance_threshold, angular_threshold);
+    if (config.clustering_method == "density")
+    {
+        fc_.setNumThreads(config.clustering_threads);
+        clusters = fc_.clusterDensity(outlier_vectors, config.distance_threshold, config.angular_threshold, config.density_min_points, config.min_cluster_size);
+    }
+    else
+    {
+        clusters = fc_.getClusters(outlier_vectors, config.distance_threshold, config.angular_threshold, config.min_cluster_size);
+    }
 
+    if (!hasSubscribers(clustered_flow_publisher_))
+    {
+        return;
+    }
     cv::Mat clustered_flow_image;
     original_image.copyTo(clustered_flow_image);
 
@@ -146,11 +250,11 @@ void MotionDetectionNode::detectOutliers(const cv::Mat &original_image, const cv
 
         if (i == 0)
         {
-            ofv_.showFlowClusters(original_image, clustered_flow_image, clusters.at(i), pixel_step_, colour, min_vector_size_);
+            ofv_.showFlowClusters(original_image, clustered_flow_image, clusters.at(i), config.pixel_step, colour, config.min_vector_size);
         }
         else
         {
-            ofv_.showFlowClusters(clustered_flow_image, temp, clusters.at(i), pixel_step_, colour, min_vector_size_);
+            ofv_.showFlowClusters(clustered_flow_image, temp, clusters.at(i), config.pixel_step, colour, config.min_vector_size);
             temp.copyTo(clustered_flow_image);
         }
     }
@@ -159,14 +263,22 @@ void MotionDetectionNode::detectOutliers(const cv::Mat &original_image, const cv
 
 }
 
-void MotionDetectionNode::clusterFlow(const cv::Mat &image, const cv::Mat &flow_vectors, std::vector<std::vector<cv::Vec4d> > &clusters)
+void MotionDetectionNode::clusterFlow(const PipelineConfig &config, const cv::Mat &image, const FlowField &flow_vectors, std::vector<std::vector<cv::Vec4d> > &clusters)
 {
-    double distance_threshold, angular_threshold;
-    nh_.getParam("distance_threshold", distance_threshold);
-    nh_.getParam("angular_threshold", angular_threshold);
-
     cv::Mat clustered_flow_image;
-    clusters = fc_.getClusters(flow_vectors, pixel_step_, distance_threshold, angular_threshold);
+    if (config.clustering_method == "density")
+    {
+        fc_.setNumThreads(config.clustering_threads);
+        clusters = fc_.clusterDensity(flow_vectors, config.distance_threshold, config.angular_threshold, config.density_min_points, config.min_cluster_size);
+    }
+    else
+    {
+        clusters = fc_.getClusters(flow_vectors, config.distance_threshold, config.angular_threshold, config.min_cluster_size);
+    }
+    if (!hasSubscribers(clustered_flow_publisher_))
+    {
+        return;
+    }
     /*
     std::cout << "clusters_second: " << std::endl;
     for (int i = 0; i < clusters.size(); i++)
@@ -192,11 +304,11 @@ void MotionDetectionNode::clusterFlow(const cv::Mat &image, const cv::Mat &flow_
 
         if (i == 0)
         {
-            ofv_.showFlowClusters(image, clustered_flow_image, clusters.at(i), pixel_step_, colour, min_vector_size_);
+            ofv_.showFlowClusters(image, clustered_flow_image, clusters.at(i), config.pixel_step, colour, config.min_vector_size);
         }
         else
         {
-            ofv_.showFlowClusters(clustered_flow_image, temp, clusters.at(i), pixel_step_, colour, min_vector_size_);
+            ofv_.showFlowClusters(clustered_flow_image, temp, clusters.at(i), config.pixel_step, colour, config.min_vector_size);
             temp.copyTo(clustered_flow_image);
         }
     }
@@ -204,9 +316,9 @@ void MotionDetectionNode::clusterFlow(const cv::Mat &image, const cv::Mat &flow_
     publishImage(clustered_flow_image, clustered_flow_publisher_);
 }
 
-void MotionDetectionNode::writeVectors(const cv::Mat &flow_vectors, const std::string &filename)
+void MotionDetectionNode::writeVectors(const PipelineConfig &config, const FlowField &flow_vectors, const std::string &filename)
 {
-    ofc_.writeFlow(flow_vectors, filename, pixel_step_); 
+    ofc_.writeFlow(flow_vectors, filename); 
 }
 
 void MotionDetectionNode::writeTrajectories(const std::vector<std::vector<cv::Point2f> > &trajectories, const std::string &filename)
@@ -216,12 +328,171 @@ void MotionDetectionNode::writeTrajectories(const std::vector<std::vector<cv::Po
 
 void MotionDetectionNode::publishImage(const cv::Mat &image, const image_transport::Publisher &publisher)
 {
+    if (!hasSubscribers(publisher))
+    {
+        return;
+    }
     cv_bridge::CvImage image_msg;
     image_msg.encoding = sensor_msgs::image_encodings::RGB8;
     image_msg.image = image;
     publisher.publish(image_msg.toImageMsg());
 }
 
+bool MotionDetectionNode::hasSubscribers(const image_transport::Publisher &publisher)
+{
+    return publisher.getNumSubscribers() > 0;
+}
+
+MotionDetectionNode::OutputRequest MotionDetectionNode::getOutputRequest(const PipelineConfig &config, int frame_count)
+{
+    OutputRequest request;
+    request.frames_path = config.frames_path;
+    request.save_frame = config.save_frames && !request.frames_path.empty() && frame_count % 5 == 0;
+
+    // the combined image is stacked from the optical flow and cluster images
+    request.combined_image = request.save_frame || hasSubscribers(compensated_flow_publisher_);
+    request.optical_flow_image = request.combined_image || record_video_ || hasSubscribers(of_image_publisher_);
+    request.cluster_image = request.combined_image || hasSubscribers(clustered_flow_publisher_);
+    request.trajectory_image = hasSubscribers(background_subtraction_publisher_);
+    request.raw_image = write_trajectories_;
+    return request;
+}
+
+bool MotionDetectionNode::OutputRequest::anyImage() const
+{
+    return optical_flow_image || trajectory_image || cluster_image || combined_image || raw_image;
+}
+
+void MotionDetectionNode::combineImages(const cv::Mat &top_image, const cv::Mat &bottom_image, cv::Mat &combined_image)
+{
+    combined_image.create(top_image.rows + bottom_image.rows, top_image.cols, CV_8UC3);
+    cv::Mat top(combined_image, cv::Rect(0, 0, top_image.cols, top_image.rows));
+    top_image.copyTo(top);
+    cv::Mat bottom(combined_image, cv::Rect(0, top_image.rows, bottom_image.cols, bottom_image.rows));
+    bottom_image.copyTo(bottom);
+}
+
+const CachedFrame &MotionDetectionNode::ingestImage(const sensor_msgs::ImageConstPtr &image, bool keep_colour)
+{
+    // the shared image points into the message, it is read exactly once
+    // while converting into the frame cache
+    cv_bridge::CvImageConstPtr cv_image;
+    ImagePreprocessor::PixelFormat format;
+    if (image->encoding == sensor_msgs::image_encodings::MONO8)
+    {
+        format = ImagePreprocessor::MONO8;
+        cv_image = cv_bridge::toCvShare(image);
+    }
+    else if (image->encoding == sensor_msgs::image_encodings::BGR8)
+    {
+        format = ImagePreprocessor::BGR8;
+        cv_image = cv_bridge::toCvShare(image);
+    }
+    else if (image->encoding == sensor_msgs::image_encodings::RGB8)
+    {
+        format = ImagePreprocessor::RGB8;
+        cv_image = cv_bridge::toCvShare(image);
+    }
+    else if (image->encoding == sensor_msgs::image_encodings::YUV422)
+    {
+        format = ImagePreprocessor::UYVY;
+        cv_image = cv_bridge::toCvShare(image);
+    }
+    else if (image->encoding == "yuv422_yuy2")
+    {
+        format = ImagePreprocessor::YUYV;
+        cv_image = cv_bridge::toCvShare(image);
+    }
+    else
+    {
+        format = ImagePreprocessor::RGB8;
+        cv_image = cv_bridge::toCvShare(image, sensor_msgs::image_encodings::RGB8);
+    }
+
+    int scale = 1;
+    if (cv_image->image.cols > 320 && (downsample_ || !use_all_frames_))
+    {
+        scale = 2;
+    }
+    return frame_cache_.addFrame(cv_image->image, format, scale, keep_colour);
+}
+
+PipelineConfig MotionDetectionNode::loadConfig()
+{
+    PipelineConfig config;
+    // streams sharing a pool already keep every core busy
+    if (shared_pool_)
+    {
+        config.ransac_threads = 1;
+        config.clustering_threads = 1;
+    }
+    nh_.param<int>("skip_frames", config.skip_frames, config.skip_frames);
+    nh_.param<int>("num_motions", config.num_motions, config.num_motions);
+    nh_.param<int>("pixel_step", config.pixel_step, config.pixel_step);
+    nh_.param<double>("min_vector_size", config.min_vector_size, config.min_vector_size);
+    nh_.param<int>("seed_border", config.seed_border, config.seed_border);
+    nh_.param<bool>("merge_tracks", config.merge_tracks, config.merge_tracks);
+    nh_.param<double>("distance_threshold", config.distance_threshold, config.distance_threshold);
+    nh_.param<int>("min_cluster_size", config.min_cluster_size, config.min_cluster_size);
+    nh_.param<double>("angular_threshold", config.angular_threshold, config.angular_threshold);
+    nh_.param<std::string>("clustering_method", config.clustering_method, config.clustering_method);
+    nh_.param<int>("density_min_points", config.density_min_points, config.density_min_points);
+    nh_.param<int>("clustering_threads", config.clustering_threads, config.clustering_threads);
+    nh_.param<double>("sigma", config.sigma, config.sigma);
+    nh_.param<double>("residual_threshold", config.residual_threshold, config.residual_threshold);
+    // a live camera gets different hypotheses in every run, as with the
+    // former srand(time(NULL)); a fixed seed makes runs reproducible
+    if (!nh_.getParam("ransac_seed", config.ransac_seed))
+    {
+        config.ransac_seed = time(NULL);
+    }
+    nh_.param<int>("ransac_threads", config.ransac_threads, config.ransac_threads);
+    nh_.param<double>("ransac_confidence", config.ransac_confidence, config.ransac_confidence);
+    nh_.param<int>("ransac_max_iterations", config.ransac_max_iterations, config.ransac_max_iterations);
+    nh_.param<int>("subspace_max_trajectories", config.subspace_max_trajectories, config.subspace_max_trajectories);
+    nh_.param<bool>("subspace_warm_start", config.subspace_warm_start, config.subspace_warm_start);
+    nh_.param<double>("warm_start_min_inlier_ratio", config.warm_start_min_inlier_ratio, config.warm_start_min_inlier_ratio);
+    nh_.param<bool>("save_frames", config.save_frames, config.save_frames);
+    nh_.param<std::string>("frames_path", config.frames_path, config.frames_path);
+    if (config.skip_frames < 1)
+    {
+        ROS_WARN("skip_frames must be at least 1");
+        config.skip_frames = 1;
+    }
+    if (config.pixel_step < 1)
+    {
+        ROS_WARN("pixel_step must be at least 1");
+        config.pixel_step = 1;
+    }
+    if (config.seed_border < 0)
+    {
+        ROS_WARN("seed_border must not be negative");
+        config.seed_border = 0;
+    }
+    if (config.clustering_method != "connected" && config.clustering_method != "density")
+    {
+        ROS_WARN("clustering_method must be connected or density");
+        config.clustering_method = "connected";
+    }
+    return config;
+}
+
+boost::shared_ptr<const PipelineConfig> MotionDetectionNode::getConfig()
+{
+    std::lock_guard<std::mutex> lock(config_mutex_);
+    return config_;
+}
+
+bool MotionDetectionNode::reloadConfigCallback(std_srvs::Empty::Request &request, std_srvs::Empty::Response &response)
+{
+    // frames in flight keep the snapshot they started with
+    boost::shared_ptr<const PipelineConfig> config(new PipelineConfig(loadConfig()));
+    std::lock_guard<std::mutex> lock(config_mutex_);
+    config_ = config;
+    ROS_INFO("[motion_detection] configuration reloaded");
+    return true;
+}
+
 void MotionDetectionNode::odomCallback(const nav_msgs::Odometry &odom)
 {
     odom_ = odom;
@@ -234,224 +505,275 @@ void MotionDetectionNode::cloudCallback(const sensor_msgs::PointCloud2 &cloud)
 
 void MotionDetectionNode::imageCallback(const sensor_msgs::ImageConstPtr &image)
 {
-    int skip_frames;
-    nh_.param<int>("skip_frames", skip_frames, 1);
-    int num_motions;
-    nh_.param<int>("num_motions", num_motions, 2);
-    trajectory_size_ = num_motions * 2 + 1;
-    if (!egomotion_)
-    {
-        trajectory_size_ = 2;
-    }
+    IngestItem item;
+    item.image = image;
+    item.received = ros::WallTime::now();
+    item.frame_count = global_frame_count_;
+    // one snapshot per frame, the parameter server is only read on reload
+    item.config = getConfig();
 
-    if (global_frame_count_ % skip_frames != 0) { global_frame_count_++; return;}
-    if (raw_images_.size() < trajectory_size_)
+    if (global_frame_count_ % item.config->skip_frames != 0) { global_frame_count_++; return;}
+
+    if (!use_all_frames_)
     {
-        raw_images_.push_back(image);        
-        if (raw_images_.size() == trajectory_size_)
+        // every frame is converted exactly once, the cache keeps the grayscale
+        // image and the LK pyramid for the rest of the window
+        frame_cache_.setCapacity(item.config->getTrajectorySize(egomotion_));
+        // run() always draws its output, so keep the colour image
+        ingestImage(image, true);
+        if (frame_cache_.isFull())
         {
             image_received_ = true;
         }
     }
-    else
+    else if (use_pipeline_)
     {
-        raw_images_.push_back(image);
-        raw_images_.pop_front();
-        image_received_ = true;
+        admitFrame(item);
     }
-    if (use_all_frames_ && image_received_ == true)
+    else
     {
-        nh_.getParam("pixel_step", pixel_step_);
-        image_received_ = true;
-        std::vector<cv::Mat> cv_images;
-        std::list<sensor_msgs::ImageConstPtr>::iterator iter = raw_images_.begin();
-        for (; iter != raw_images_.end(); ++iter)            
+        // frames are tracked as they arrive, so only the stride applies; the
+        // subscriber queue drops frames without telling us
+        long index = received_frames_++;
+        if (keep_latest_ || index % ingest_stride_ == 0)
         {
-            cv_bridge::CvImagePtr cv_image;
-            cv_image = cv_bridge::toCvCopy(*iter, "rgb8");
-            if (cv_image->image.cols > 320)
-            {
-                /*
-                cv::Rect region(200, 0, cv_image->image.cols - 400, cv_image->image.rows);
-                cv::Mat resized = cv_image->image(region);
-                cv::resize(resized, resized, cv::Size(), 0.5, 0.5);
-                cv_images.push_back(resized);
-                */
-                cv_images.push_back(cv_image->image);
-
-            }
-            else
-            {
-                cv_images.push_back(cv_image->image);
-            }
+            trackFrame(item);
         }
-        cv::Mat optical_flow_vectors;
-        cv::Mat outlier_mask;
-        std::vector<std::vector<cv::Point2f> > trajectories;
-        //std::vector<std::vector<cv::Vec4d> > clusters;
-        std::vector<std::vector<cv::Point2f> > clusters;
-        //runOpticalFlow(cv_image1->image, cv_image2->image, optical_flow_vectors);
-        cv::Mat optical_flow_image;
-        runOpticalFlowTrajectory(cv_images, optical_flow_vectors, trajectories, optical_flow_image);
-        if (trajectories.empty())
+        else
         {
-            std::cout << "no trajectories found " << std::endl;
-            cv::Mat cluster_image;
-            cv::Mat trajectory_image;
-            cv::Mat optical_flow_image;
-            cv_images.back().copyTo(cluster_image);
-            cv_images.back().copyTo(trajectory_image);
-            cv_images.back().copyTo(optical_flow_image);
-
-            publishImage(trajectory_image, background_subtraction_publisher_);
-            publishImage(cluster_image, clustered_flow_publisher_);
-            cv::Mat combined_image(2 * cluster_image.rows, cluster_image.cols, CV_8UC3);
-            cv::Mat top(combined_image, cv::Rect(0, 0, optical_flow_image.cols, optical_flow_image.rows));
-            optical_flow_image.copyTo(top);
-            cv::Mat bottom(combined_image, cv::Rect(0, optical_flow_image.rows, cluster_image.cols, cluster_image.rows));
-            cluster_image.copyTo(bottom);
-            publishImage(combined_image, compensated_flow_publisher_);
-            frame_number_++;
-            global_frame_count_++;
+            dropped_frames_++;
+        }
+    }
+    global_frame_count_++;
+}
 
-            return;
+void MotionDetectionNode::admitFrame(const IngestItem &item)
+{
+    long index = received_frames_++;
+    if (keep_latest_)
+    {
+        int dropped = ingest_queue_.pushDropOldest(item);
+        dropped_frames_ += dropped;
+        if (dropped == 0)
+        {
+            // a replaced frame is picked up by the task posted for it
+            pool_->post(tracking_strand_, std::bind(&MotionDetectionNode::trackNextFrame, this));
         }
+        return;
+    }
+    // dropping the new frame keeps the admitted frames evenly spaced
+    if (index % ingest_stride_ != 0 || !ingest_queue_.tryPush(item))
+    {
+        dropped_frames_++;
+        return;
+    }
+    pool_->post(tracking_strand_, std::bind(&MotionDetectionNode::trackNextFrame, this));
+}
+
+void MotionDetectionNode::trackFrame(const IngestItem &item)
+{
+    const PipelineConfig &config = *item.config;
+    int trajectory_size = config.getTrajectorySize(egomotion_);
+
+    // the window only ever sees admitted frames, so dropping a frame
+    // lengthens one LK step instead of breaking the trajectories
+    frame_cache_.setCapacity(trajectory_size);
+
+    boost::shared_ptr<FrameData> data(new FrameData);
+    data->config = item.config;
+    data->frame_count = item.frame_count;
+    data->received = item.received;
+    data->request = getOutputRequest(config, item.frame_count);
+    const CachedFrame &frame = ingestImage(item.image, data->request.anyImage());
+    if (!detector_.track(config, frame, data->result))
+    {
+        return;
+    }
+    // the cache slot is overwritten by a later frame while the
+    // later stages may still be drawing on it
+    data->image = pool_ != NULL ? frame.image.clone() : frame.image;
+    if (pool_ != NULL)
+    {
+        frames_downstream_++;
+        pool_->post(detection_strand_, std::bind(&MotionDetectionNode::detectAndForward, this, data));
+    }
+    else
+    {
+        detectMotion(*data);
+        publishResults(*data);
+        reportLatency(*data);
+    }
+}
 
-        double distance_threshold;
-        nh_.getParam("distance_threshold", distance_threshold);
+void MotionDetectionNode::reportLatency(const FrameData &data)
+{
+    double latency = (ros::WallTime::now() - data.received).toSec();
+    latency_sum_ += latency;
+    latency_max_ = std::max(latency_max_, latency);
+    latency_count_++;
 
-        /*
-        int long_trajectories = 0;
-        for (int i = 0; i < trajectories.size(); i++)
+    ros::WallTime now = ros::WallTime::now();
+    if ((now - last_latency_report_).toSec() < 5.0)
+    {
+        return;
+    }
+    if (pool_ != NULL)
+    {
+        ROS_INFO("[%s] latency mean %.3f s, max %.3f s over %d frames; dropped %ld of %ld frames at ingest and %ld older than max_ingest_latency; "
+                 "tracking waited %ld times for detection and output",
+                 nh_.getNamespace().c_str(), latency_sum_ / latency_count_, latency_max_, latency_count_, (long)dropped_frames_, (long)received_frames_,
+                 (long)stale_frames_, (long)tracking_waits_);
+    }
+    else
+    {
+        ROS_INFO("[%s] latency mean %.3f s, max %.3f s over %d frames; skipped %ld of %ld received frames by ingest_stride",
+                 nh_.getNamespace().c_str(), latency_sum_ / latency_count_, latency_max_, latency_count_, (long)dropped_frames_, (long)received_frames_);
+    }
+    latency_sum_ = 0.0;
+    latency_max_ = 0.0;
+    latency_count_ = 0;
+    last_latency_report_ = now;
+}
+
+void MotionDetectionNode::detectMotion(FrameData &data)
+{
+    detector_.detect(*data.config, data.result);
+}
+
+void MotionDetectionNode::publishResults(FrameData &data)
+{
+    const PipelineConfig &config = *data.config;
+    const OutputRequest &request = data.request;
+
+    cv::Mat optical_flow_image;
+    if (request.optical_flow_image)
+    {
+        showOpticalFlow(config, data.image, data.result.optical_flow_vectors, optical_flow_image);
+    }
+
+    if (data.result.tracks.size() == 0)
+    {
+        std::cout << "no trajectories found " << std::endl;
+        if (request.trajectory_image)
         {
-            std::vector<cv::Point2f> line = trajectories.at(i);
-            int length = line.size();
-            double traj_length = std::sqrt( (std::pow((line[0].x - line[length-1].x), 2.0) + std::pow((line[0].y - line[length-1].y), 2.0)));
-            if (traj_length > distance_threshold / 5)
-            {
-                long_trajectories++;
-            }
-            else
-            {
-                std::cout << "length: " << traj_length << std::endl;
-            }
+            publishImage(data.image, background_subtraction_publisher_);
         }
-        std::cout << "long trajectories " << long_trajectories << std::endl;
-        */
-        //if (long_trajectories > (0.5 * cv_images[0].rows * cv_images[0].cols) / (pixel_step_ * pixel_step_))
-        if (egomotion_)
+        if (request.cluster_image)
         {
-            std::vector<cv::Point2f> outlier_points;
-            double sigma;
-            nh_.param<double>("sigma", sigma, 0.5);
-            std::vector<std::vector<cv::Point2f> > trajectory_subspace_vectors;
-            trajectory_subspace_vectors = od_.fitSubspace(trajectories, outlier_points, num_motions, sigma);
-
-            cv::Mat trajectory_image;
-            tv_.showTrajectories(cv_images.back(), trajectory_image, trajectory_subspace_vectors);
-            // TODO: rename the publisher
-            publishImage(trajectory_image, background_subtraction_publisher_);
-
-            clusters = fc_.clusterEuclidean(outlier_points, distance_threshold);
+            publishImage(data.image, clustered_flow_publisher_);
         }
-        else
+        if (request.combined_image)
         {
-            ROS_INFO("no egomotion");
-            std::vector<cv::Point2f> points;
-            for (int i = 0; i < trajectories.size(); i++)
-            {
-                int length = trajectories.at(i).size();
-                std::vector<cv::Point2f> line = trajectories.at(i);
-                double traj_length = std::sqrt( (std::pow((line[0].x - line[length-1].x), 2.0) + std::pow((line[0].y - line[length-1].y), 2.0)));
-                if (traj_length > distance_threshold / 5)
-                {
-                    points.push_back(trajectories.at(i).at(length - 1));
-                }
-            }
-            //clusters = fc_.clusterEuclidean(points, distance_threshold);
-            std::vector<std::vector<cv::Vec4d> > cluster_vec;
-            double angular_threshold;
-            nh_.getParam("angular_threshold", angular_threshold);
-            cluster_vec = fc_.getClusters(optical_flow_vectors, pixel_step_, distance_threshold, angular_threshold);
-            for (int i = 0; i < cluster_vec.size(); i++)
-            {
-                std::vector<cv::Point2f> cc;
-                std::vector<cv::Vec4d> cc_v = cluster_vec.at(i);
-                for (int j = 0; j < cc_v.size(); j++)
-                {
-                    cv::Point2f point(cc_v.at(j)[0], cc_v.at(j)[1]);
-                    cc.push_back(point);
-                }
-                clusters.push_back(cc);
-            }
-            std::cout << "clusters size " << clusters.size() << std::endl;
-            std::cout << "clusters  vecsize " << cluster_vec.size() << std::endl;
+            cv::Mat combined_image;
+            combineImages(data.image, data.image, combined_image);
+            publishImage(combined_image, compensated_flow_publisher_);
         }
+        frame_number_++;
+        return;
+    }
 
-        cv::Mat cluster_image;
-        std::vector<std::vector<cv::Point> > contours;
-        //contours = ofv_.showClusterContours(cv_images.back(), cluster_image, clusters);        
-        std::vector<cv::Rect> rectangles;
-        rectangles = ofv_.showBoundingBoxes(cv_images.back(), cluster_image, clusters);
+    if (egomotion_ && request.trajectory_image)
+    {
+        cv::Mat trajectory_image;
+        tv_.showTrajectories(data.image, trajectory_image, data.result.trajectory_subspace_vectors);
+        // TODO: rename the publisher
+        publishImage(trajectory_image, background_subtraction_publisher_);
+    }
+
+    cv::Mat cluster_image;
+    std::vector<std::vector<cv::Point> > contours;
+    //contours = ofv_.showClusterContours(cv_images.back(), cluster_image, clusters);        
+    const std::vector<cv::Rect> &rectangles = data.result.bounding_boxes;
+    if (request.cluster_image)
+    {
+        ofv_.drawBoundingBoxes(data.image, cluster_image, rectangles);
         publishImage(cluster_image, clustered_flow_publisher_);
+    }
 
-        cv::Mat combined_image(2 * cluster_image.rows, cluster_image.cols, CV_8UC3);
-        cv::Mat top(combined_image, cv::Rect(0, 0, optical_flow_image.cols, optical_flow_image.rows));
-        optical_flow_image.copyTo(top);
-        cv::Mat bottom(combined_image, cv::Rect(0, optical_flow_image.rows, cluster_image.cols, cluster_image.rows));
-        cluster_image.copyTo(bottom);
+    cv::Mat combined_image;
+    if (request.combined_image)
+    {
+        combineImages(optical_flow_image, cluster_image, combined_image);
         publishImage(combined_image, compensated_flow_publisher_);
+    }
 
-        //detectOutliers(cv_image1->image, optical_flow_vectors, outlier_mask, include_zeros_); 
-        //clusterFlow(cv_image1->image, optical_flow_vectors, clusters);
-        frame_number_++;
-        if (write_vectors_)
-        {
-            std::stringstream ss;
-            ss << frame_number_;
-            std::string filename = "/home/santosh/data/frame" + ss.str();
-            writeVectors(optical_flow_vectors, filename);
-        }
-        if (write_trajectories_)
+    //detectOutliers(cv_image1->image, optical_flow_vectors, outlier_mask, include_zeros_); 
+    //clusterFlow(cv_image1->image, optical_flow_vectors, clusters);
+    frame_number_++;
+    if (write_vectors_)
+    {
+        std::stringstream ss;
+        ss << frame_number_;
+        std::string filename = "/home/santosh/data/frame" + ss.str();
+        writeVectors(config, data.result.optical_flow_vectors, filename);
+    }
+    if (write_trajectories_)
+    {
+        std::stringstream ss;
+        ss << frame_number_;
+        std::string filename = "/home/santosh/workspace/rnd/outlier/frame" + ss.str();
+        std::vector<std::vector<cv::Point2f> > trajectories;
+        data.result.tracks.getTrajectories(trajectories);
+        writeTrajectories(trajectories, filename);
+        cv::imwrite("/home/santosh/workspace/rnd/outlier/frame.jpg", data.image);
+    }
+    if (log_contours_)
+    {
+        /*
+        for (int i = 0; i < contours.size(); i++)
         {
-            std::stringstream ss;
-            ss << frame_number_;
-            std::string filename = "/home/santosh/workspace/rnd/outlier/frame" + ss.str();
-            writeTrajectories(trajectories, filename);
-            cv::imwrite("/home/santosh/workspace/rnd/outlier/frame.jpg", cv_images.back());
+            ml_.writeContour(contours.at(i), global_frame_count_, i);
         }
-        if (log_contours_)
+        */
+        for (int i = 0; i < rectangles.size(); i++)
         {
-            /*
-            for (int i = 0; i < contours.size(); i++)
-            {
-                ml_.writeContour(contours.at(i), global_frame_count_, i);
-            }
-            */
-            for (int i = 0; i < rectangles.size(); i++)
-            {
-                ml_.writeBoundingBox(rectangles.at(i), global_frame_count_, i);
-            }
+            ml_.writeBoundingBox(rectangles.at(i), data.frame_count, i);
         }
-        bool save_frames;
-        nh_.param<bool>("save_frames", save_frames, false);
-        if (save_frames)
+    }
+    if (request.save_frame)
+    {
+        std::stringstream ss;
+        ss << data.frame_count;
+        cv::cvtColor(combined_image, combined_image, CV_BGR2RGB);
+        cv::imwrite(request.frames_path + "frame" + ss.str() + ".jpg", combined_image); 
+    }
+}
+
+void MotionDetectionNode::trackNextFrame()
+{
+    // a tracked frame is never dropped: while detection and output are
+    // full, frames wait in the ingest queue, where the ingest policy drops
+    // them, and outputFrame posts this task again once there is room
+    if (frames_downstream_ >= max_frames_downstream_)
+    {
+        tracking_waits_++;
+        return;
+    }
+    IngestItem item;
+    while (ingest_queue_.tryPop(item))
+    {
+        if (max_ingest_latency_ > 0.0 && (ros::WallTime::now() - item.received).toSec() > max_ingest_latency_)
         {
-            std::string frames_path;
-            nh_.param<std::string>("frames_path", frames_path, "");
-            if (!frames_path.empty())
-            {
-                if (global_frame_count_ % 5 == 0)
-                {
-                    std::stringstream ss;
-                    ss << global_frame_count_;
-                    cv::cvtColor(combined_image, combined_image, CV_BGR2RGB);
-                    cv::imwrite(frames_path + "frame" + ss.str() + ".jpg", combined_image); 
-                }
-            }
+            stale_frames_++;
+            continue;
         }
+        trackFrame(item);
+        return;
     }
-    global_frame_count_++;
+}
+
+void MotionDetectionNode::detectAndForward(const boost::shared_ptr<FrameData> &data)
+{
+    detectMotion(*data);
+    pool_->post(output_strand_, std::bind(&MotionDetectionNode::outputFrame, this, data));
+}
+
+void MotionDetectionNode::outputFrame(const boost::shared_ptr<FrameData> &data)
+{
+    publishResults(*data);
+    reportLatency(*data);
+    frames_downstream_--;
+    pool_->post(tracking_strand_, std::bind(&MotionDetectionNode::trackNextFrame, this));
 }
 
 void MotionDetectionNode::run()
@@ -461,40 +783,36 @@ void MotionDetectionNode::run()
         ros::Rate(100).sleep();
         ros::spinOnce();
     }
+    boost::shared_ptr<const PipelineConfig> config = getConfig();
     std::vector<cv::Mat> cv_images;
-    std::list<sensor_msgs::ImageConstPtr>::iterator iter = raw_images_.begin();
-    for (; iter != raw_images_.end(); ++iter)            
+    std::vector<std::vector<cv::Mat> > pyramids;
+    for (int i = 0; i < frame_cache_.size(); i++)
     {
-        cv_bridge::CvImagePtr cv_image;
-        cv_image = cv_bridge::toCvCopy(*iter, "rgb8");
-        if (cv_image->image.cols > 320)
-        {
-            cv::Mat resized;
-            cv::resize(cv_image->image, resized, cv::Size(), 0.5, 0.5);
-            cv_images.push_back(resized);
-        }
-        else
-        {
-            cv_images.push_back(cv_image->image);
-        }
+        cv_images.push_back(frame_cache_.at(i).image);
     }
-    cv::Mat optical_flow_vectors;
+    frame_cache_.getPyramids(pyramids);
+    FlowField optical_flow_vectors;
     cv::Mat outlier_mask;
     std::vector<std::vector<cv::Point2f> > trajectories;
     //std::vector<std::vector<cv::Vec4d> > clusters;
     std::vector<std::vector<cv::Point2f> > clusters;
     //runOpticalFlow(cv_image1->image, cv_image2->image, optical_flow_vectors);
     cv::Mat optical_flow_image;
-    runOpticalFlowTrajectory(cv_images, optical_flow_vectors, trajectories, optical_flow_image);
+    runOpticalFlowTrajectory(*config, cv_images, pyramids, optical_flow_vectors, trajectories, optical_flow_image);
     std::vector<cv::Point2f> outlier_points;
-    double residual_threshold;
-    nh_.param<double>("residual_threshold", residual_threshold, 0.2);
-    int num_motions;
-    nh_.param<int>("num_motions", num_motions, 2);
-    od_.fitSubspace(trajectories, outlier_points, 2, residual_threshold); 
-    double distance_threshold;
-    nh_.getParam("distance_threshold", distance_threshold);
-    clusters = fc_.clusterEuclidean(outlier_points, distance_threshold);
+    od_.setRansacParameters(config->ransac_seed, config->ransac_threads, config->ransac_confidence, config->ransac_max_iterations);
+    od_.setWarmStart(config->subspace_warm_start, config->warm_start_min_inlier_ratio);
+    od_.setMaxTrajectories(config->subspace_max_trajectories);
+    od_.fitSubspace(trajectories, outlier_points, 2, config->residual_threshold); 
+    if (config->clustering_method == "density")
+    {
+        fc_.setNumThreads(config->clustering_threads);
+        clusters = fc_.clusterDensity(outlier_points, config->distance_threshold, config->density_min_points, config->min_cluster_size);
+    }
+    else
+    {
+        clusters = fc_.clusterEuclidean(outlier_points, config->distance_threshold, config->min_cluster_size);
+    }
     /*
     std::cout << "clusters" << clusters.size() << std::endl;
     for (int i = 0; i < clusters.size(); i++)
@@ -517,7 +835,7 @@ void MotionDetectionNode::run()
         std::stringstream ss;
         ss << frame_number_;
         std::string filename = "/home/santosh/data/frame" + ss.str();
-        writeVectors(optical_flow_vectors, filename);
+        writeVectors(*config, optical_flow_vectors, filename);
     }
     if (write_trajectories_)
     {
@@ -567,8 +885,34 @@ int main(int argc, char **argv)
     bool use_all_frames;
     n.param<bool>("use_all_frames", use_all_frames, true);
 
+    // one window, tracker and set of publishers per stream, all sharing one
+    // pool; each stream reads its parameters from ~<stream>/
+    std::vector<std::string> input_streams;
+    n.getParam("input_streams", input_streams);
+
     ROS_INFO("[motion_detection] node started");
 
+    if (!input_streams.empty() && use_all_frames)
+    {
+        int num_threads;
+        n.param<int>("num_threads", num_threads, 0);
+        ThreadPool pool(num_threads);
+        ROS_INFO("[motion_detection] serving %d streams with %d threads", (int)input_streams.size(), pool.getNumThreads());
+
+        std::vector<boost::shared_ptr<MotionDetectionNode> > nodes;
+        for (int i = 0; i < input_streams.size(); i++)
+        {
+            ros::NodeHandle stream_nh(n, input_streams.at(i));
+            // the polling run() loop only serves a single stream
+            stream_nh.setParam("use_all_frames", true);
+            nodes.push_back(boost::shared_ptr<MotionDetectionNode>(new MotionDetectionNode(stream_nh, &pool)));
+        }
+        ros::spin();
+        // the nodes drain their strands before the pool shuts down
+        nodes.clear();
+        return 0;
+    }
+
     MotionDetectionNode mdn(n); 
     if (use_all_frames)
     {